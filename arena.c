@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+#define ARENA_ALIGN 8
+#define ARENA_DEFAULT_CHUNK (1<<20)
+
+static arena_chunk_t *arena_chunk(arena_t *a, size_t m) {
+  arena_chunk_t *c = malloc(sizeof(arena_chunk_t));
+  c->s = calloc(m, 1);
+  if (!c->s) {
+    fprintf(stderr, "[%s] error: out of memory allocating %zu bytes.\n", __func__, m);
+    exit(1);
+  }
+  c->l = 0;
+  c->m = m;
+  a->n_chunks++;
+  a->reserved += m;
+  return c;
+}
+
+arena_t *arena_init(size_t chunk_size) {
+  arena_t *a = calloc(1, sizeof(arena_t));
+  a->chunk_size = chunk_size ? chunk_size : ARENA_DEFAULT_CHUNK;
+  return a;
+}
+
+void *arena_alloc(arena_t *a, size_t n) {
+  arena_chunk_t *c;
+  void *p;
+  n = (n + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1);
+  if (n > a->chunk_size/4) {
+    /* large blocks get a chunk of their own, behind the current one,
+       so the remainder of the current chunk is not wasted */
+    c = arena_chunk(a, n);
+    c->l = n;
+    if (a->head) {
+      c->next = a->head->next;
+      a->head->next = c;
+    } else {
+      c->next = NULL;
+      a->head = c;
+    }
+    return c->s;
+  }
+  if (!a->head || a->head->l + n > a->head->m) {
+    c = arena_chunk(a, a->chunk_size);
+    c->next = a->head;
+    a->head = c;
+  }
+  p = a->head->s + a->head->l;
+  a->head->l += n;
+  return p;
+}
+
+char *arena_strndup(arena_t *a, const char *s, size_t n) {
+  char *p = arena_alloc(a, n + 1);
+  memcpy(p, s, n);
+  p[n] = 0;
+  return p;
+}
+
+char *arena_strdup(arena_t *a, const char *s) {
+  return arena_strndup(a, s, strlen(s));
+}
+
+void arena_destroy(arena_t *a) {
+  arena_chunk_t *c, *next;
+  if (!a) return;
+  for (c = a->head; c; c = next) {
+    next = c->next;
+    free(c->s);
+    free(c);
+  }
+  free(a);
+}
@@ -0,0 +1,30 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/* 
+   Region allocator: many small, long-lived allocations are carved out
+   of large chunks and released all at once with arena_destroy().
+   Memory returned by arena_alloc() is zeroed and 8-byte aligned.
+*/
+
+typedef struct _arena_chunk_t {
+  struct _arena_chunk_t *next;
+  size_t l, m;
+  char *s;
+} arena_chunk_t;
+
+typedef struct {
+  size_t chunk_size;
+  size_t n_chunks, reserved;
+  arena_chunk_t *head;
+} arena_t;
+
+arena_t *arena_init(size_t chunk_size);
+void *arena_alloc(arena_t *a, size_t n);
+char *arena_strndup(arena_t *a, const char *s, size_t n);
+char *arena_strdup(arena_t *a, const char *s);
+void arena_destroy(arena_t *a);
+
+#endif
@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bam.h"
+
+static const char *nt16 = "=ACMGRSVTWYHKDBN";
+static const unsigned char nt16_comp[16] = {0, 8, 4, 12, 2, 10, 6, 14, 1, 9, 5, 13, 3, 11, 7, 15};
+static char base_pairs[256][2]; /* both bases of a packed byte */
+
+static inline unsigned le16(const unsigned char *p) { return p[0] | p[1] << 8; }
+static inline uint32_t le32(const unsigned char *p) {
+  return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+static void ks_reserve(kstring_t *s, size_t n) {
+  if (s->m < n) {
+    s->m = n;
+    kroundup32(s->m);
+    s->s = realloc(s->s, s->m);
+    if (!s->s) {
+      fprintf(stderr, "[%s] error: out of memory.\n", __func__);
+      exit(1);
+    }
+  }
+}
+
+static unsigned char *rec_reserve(bam_t *b, size_t n) {
+  if (b->m_rec < n) {
+    b->m_rec = n;
+    kroundup32(b->m_rec);
+    b->rec = realloc(b->rec, b->m_rec);
+    if (!b->rec) {
+      fprintf(stderr, "[%s] error: out of memory.\n", __func__);
+      exit(1);
+    }
+  }
+  return b->rec;
+}
+
+/* whether the decoded input starts with the BAM magic */
+int bam_sniff(uio_in_t *in) {
+  unsigned char m[4];
+  return uio_peek(in, m, 4) == 4 && !memcmp(m, "BAM\1", 4);
+}
+
+static int bam_skip(bam_t *b, size_t n) {
+  size_t k;
+  while (n) {
+    k = n < UIO_BUFSIZE ? n : UIO_BUFSIZE;
+    if ((size_t) uio_read(b->in, rec_reserve(b, k), k) < k) return -1;
+    n -= k;
+  }
+  return 0;
+}
+
+/* reads records from in, which stays open; the header (text and reference names) is skipped */
+bam_t *bam_open(uio_in_t *in, int qual_off) {
+  bam_t *b = calloc(1, sizeof(bam_t));
+  unsigned char h[8];
+  uint32_t n_ref, i;
+  unsigned c;
+
+  for (c = 0; c < 256; c++) {
+    base_pairs[c][0] = nt16[c >> 4];
+    base_pairs[c][1] = nt16[c & 15];
+  }
+  b->qual_off = qual_off;
+  b->in = in;
+  if (uio_read(b->in, h, 8) < 8 || memcmp(h, "BAM\1", 4) || bam_skip(b, le32(h + 4))
+      || uio_read(b->in, h, 4) < 4)
+    goto truncated;
+  for (n_ref = le32(h), i = 0; i < n_ref; i++)
+    if (uio_read(b->in, h, 4) < 4 || bam_skip(b, le32(h) + 4)) goto truncated;
+  return b;
+
+ truncated:
+  fprintf(stderr, "[%s] error: truncated BAM header.\n", __func__);
+  bam_close(b);
+  return NULL;
+}
+
+/*
+   The next primary record; returns the sequence length, or -1 at the
+   end of input. A record without qualities gets an empty quality
+   string, like a FASTA record.
+*/
+int bam_read(bam_t *b, kstring_t *name, kstring_t *seq, kstring_t *qual, unsigned *flag) {
+  const unsigned char *r, *s, *q;
+  unsigned char h[4];
+  uint32_t size, l_name, n_cigar, l_seq, i, j;
+  unsigned f;
+  int n;
+
+  do {
+    if (!(n = uio_read(b->in, h, 4))) return -1;
+    if (n < 4) goto truncated;
+    size = le32(h);
+    /* checked before allocating, so a corrupt size cannot ask for gigabytes */
+    if (size < 32 || size > BAM_MAX_RECORD) goto corrupt;
+    if ((uint32_t) uio_read(b->in, rec_reserve(b, size), size) < size) goto truncated;
+    r = b->rec;
+    l_name = r[8];
+    n_cigar = le16(r + 12);
+    l_seq = le32(r + 16);
+    if (!l_name || (uint64_t) 32 + l_name + 4*n_cigar + (l_seq+1)/2 + l_seq > size) goto corrupt;
+    f = le16(r + 14);
+  } while (f & (BAM_FSECONDARY|BAM_FSUPPLEMENTARY));
+
+  ks_reserve(name, l_name);
+  memcpy(name->s, r + 32, l_name - 1);
+  name->l = l_name - 1;
+  name->s[name->l] = 0;
+
+  s = r + 32 + l_name + 4*n_cigar;
+  q = s + (l_seq+1)/2;
+  ks_reserve(seq, l_seq + 2);
+  ks_reserve(qual, l_seq + 1);
+  if (f & BAM_FREVERSE) {
+    for (i = 0, j = l_seq - 1; i < l_seq; i++, j--)
+      seq->s[i] = nt16[nt16_comp[s[j>>1] >> ((~j & 1) << 2) & 15]];
+    for (i = 0, j = l_seq - 1; i < l_seq; i++, j--) qual->s[i] = q[j] + b->qual_off;
+  } else {
+    /* two bases at a time; an odd length writes one past the end */
+    for (i = 0; i < l_seq; i += 2) memcpy(seq->s + i, base_pairs[s[i>>1]], 2);
+    for (i = 0; i < l_seq; i++) qual->s[i] = q[i] + b->qual_off;
+  }
+  seq->l = l_seq;
+  seq->s[l_seq] = 0;
+  qual->l = l_seq && q[0] == 0xff ? 0 : l_seq;
+  qual->s[qual->l] = 0;
+  *flag = f;
+  return l_seq;
+
+ corrupt:
+  fprintf(stderr, "[%s] error: corrupt BAM record.\n", __func__);
+  exit(1);
+
+ truncated:
+  fprintf(stderr, "[%s] warning: truncated BAM input.\n", __func__);
+  return -1;
+}
+
+void bam_close(bam_t *b) {
+  if (!b) return;
+  free(b->rec);
+  free(b);
+}
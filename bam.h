@@ -0,0 +1,39 @@
+#ifndef BAM_H
+#define BAM_H
+
+#include <stdint.h>
+#ifndef KSTRING_T
+#include "kseq.h"
+#endif
+#include "uio.h"
+
+/*
+   Unaligned BAM input, as written by basecallers and Picard's
+   FastqToSam. Records are decoded straight into kseq's name, sequence
+   and quality strings, with no FASTQ text in between. Secondary and
+   supplementary records are skipped, and reverse-strand records are
+   turned back to the strand they were sequenced on.
+*/
+
+#define BAM_FPAIRED 0x1
+#define BAM_FREVERSE 0x10
+#define BAM_FREAD1 0x40
+#define BAM_FREAD2 0x80
+#define BAM_FSECONDARY 0x100
+#define BAM_FSUPPLEMENTARY 0x800
+
+#define BAM_MAX_RECORD (1<<28) /* larger record sizes are taken as corrupt */
+
+typedef struct {
+  uio_in_t *in;
+  int qual_off; /* added to raw qualities, e.g. 33 for Sanger */
+  unsigned char *rec;
+  size_t m_rec;
+} bam_t;
+
+int bam_sniff(uio_in_t *in);
+bam_t *bam_open(uio_in_t *in, int qual_off);
+int bam_read(bam_t *b, kstring_t *name, kstring_t *seq, kstring_t *qual, unsigned *flag);
+void bam_close(bam_t *b);
+
+#endif
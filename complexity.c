@@ -0,0 +1,44 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "complexity.h"
+
+complexity_t *complexity_init(void) {
+  return calloc(1, sizeof(complexity_t));
+}
+
+static uint64_t *cx_grow(uint64_t *a, size_t *m, size_t n, unsigned ncol) {
+  size_t old = *m;
+  if (n <= old) return a;
+  for (*m = old ? old : 64; *m < n; *m *= 2);
+  a = realloc(a, *m*ncol*sizeof(uint64_t));
+  if (!a) {
+    fprintf(stderr, "[%s] error: out of memory.\n", __func__);
+    exit(1);
+  }
+  memset(a + old*ncol, 0, (*m - old)*ncol*sizeof(uint64_t));
+  return a;
+}
+
+/* a read ending in a run of base (as seq_nt4_table), starting at onset_row */
+void complexity_add(complexity_t *cx, unsigned run, unsigned base, unsigned onset_row, double score) {
+  unsigned s = score < CX_SCORES - 1 ? (unsigned) score : CX_SCORES - 1;
+  cx->n_reads++;
+  if (!run) return;
+  if (run > CX_MAX_RUN) run = CX_MAX_RUN;
+  cx->run = cx_grow(cx->run, &cx->m_run, run + 1, 5);
+  cx->run[run*5 + base]++;
+  if (base == 2 && run >= CX_POLYG) {
+    cx->onset = cx_grow(cx->onset, &cx->m_onset, onset_row + 1, 1);
+    cx->onset[onset_row]++;
+    cx->n_polyg++;
+  }
+  cx->score[s]++;
+  if (score > CX_LOW) cx->n_low++;
+}
+
+void complexity_destroy(complexity_t *cx) {
+  if (!cx) return;
+  free(cx->run);
+  free(cx->onset);
+  free(cx);
+}
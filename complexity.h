@@ -0,0 +1,94 @@
+#ifndef COMPLEXITY_H
+#define COMPLEXITY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "spectrum.h"
+
+/*
+   Homopolymer tails and low-complexity reads, from one scan of each
+   read, a base at a time. Each read keeps its trailing
+   run (two-color chemistry reads no signal as G, so failing clusters
+   end in poly-G) and a DUST score: triplet counts c_t over a sliding
+   window of CX_WINDOW bases, scored as sum c_t(c_t-1)/2 over the
+   number of triplets less one, as in sdust. Adding or dropping a
+   triplet changes the sum by its count, so each base costs a table
+   lookup and a few adds. Also as in sdust, a non-ACGT base ends the
+   window, and the next one starts empty after it.
+*/
+
+#define CX_WINDOW 64
+#define CX_TRIPLETS (CX_WINDOW - 2)
+#define CX_SCORES 32 /* the highest score, all one triplet, is 31 */
+#define CX_LOW 20 /* reads scoring above this are low-complexity */
+#define CX_POLYG 10 /* shortest G run counted as a poly-G tail */
+#define CX_MAX_RUN 1000 /* longer trailing runs are counted here */
+
+typedef struct {
+  uint64_t n_reads, n_polyg, n_low;
+  uint64_t *run; /* reads by trailing run length, columns ACGTN */
+  size_t m_run;
+  uint64_t *onset; /* poly-G tails by matrix row of their first base */
+  size_t m_onset;
+  uint64_t score[CX_SCORES]; /* reads by highest window score */
+} complexity_t;
+
+/* rolling state of the current read */
+typedef struct {
+  unsigned run, run_b; /* length and base (seq_nt4_table) of the current run */
+  unsigned t, n; /* last triplet, and ACGT bases since the last other base */
+  unsigned score, best, n_win, head;
+  double done; /* highest score of the windows before the last non-ACGT base */
+  uint8_t ring[64]; /* triplets by head, so the oldest in a full window is CX_TRIPLETS back */
+  uint8_t counts[64];
+} cx_roll_t;
+
+complexity_t *complexity_init(void);
+void complexity_add(complexity_t *cx, unsigned run, unsigned base, unsigned onset_row, double score);
+void complexity_destroy(complexity_t *cx);
+
+static inline void complexity_start(cx_roll_t *r) {
+  memset(r, 0, sizeof(cx_roll_t));
+  r->run_b = 5;
+}
+
+/* the score of the best window since the last non-ACGT base */
+static inline double complexity_score(const cx_roll_t *r) {
+  return r->n_win > 1 ? (double) r->best/(r->n_win - 1) : 0;
+}
+
+/* push the next base of a read; non-ACGT bases restart the triplet and the window */
+static inline void complexity_base(cx_roll_t *r, char c) {
+  unsigned b = seq_nt4_table[(unsigned char) c];
+  r->run = b == r->run_b ? r->run + 1 : 1;
+  r->run_b = b;
+  if (b > 3) {
+    if (r->n_win) {
+      if (complexity_score(r) > r->done) r->done = complexity_score(r);
+      r->score = r->best = r->n_win = 0;
+      memset(r->counts, 0, sizeof(r->counts));
+    }
+    r->n = 0;
+    return;
+  }
+  r->t = (r->t << 2 | b) & 63;
+  if (++r->n < 3) return;
+  if (r->n_win == CX_TRIPLETS) r->score -= --r->counts[r->ring[(r->head - CX_TRIPLETS) & 63]];
+  else r->n_win++;
+  r->score += r->counts[r->t]++;
+  r->ring[r->head++ & 63] = r->t;
+  r->best = r->score > r->best ? r->score : r->best;
+}
+
+/*
+   Count the finished read; onset_row is the row of its trailing run's
+   first base. Inline, so the rolling state never leaves the caller
+   and can stay in registers through the loop.
+*/
+static inline void complexity_end(complexity_t *cx, const cx_roll_t *r, unsigned onset_row) {
+  double score = complexity_score(r);
+  complexity_add(cx, r->run, r->run_b, onset_row, score > r->done ? score : r->done);
+}
+
+#endif
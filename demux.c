@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "khash.h"
+#include "demux.h"
+
+KHASH_MAP_INIT_STR(idx, int)
+
+static const char bases[] = "ACGTN";
+
+/* a key pointing to sample value, unless another sample claims it too */
+static void demux_put(khash_t(idx) *h, const char *key, int value) {
+  khiter_t it;
+  int ret;
+  it = kh_put(idx, h, key, &ret);
+  if (ret) {
+    kh_key(h, it) = strdup(key);
+    kh_value(h, it) = value;
+  } else if (!(value & 1)) {
+    /* an exact index wins over substitutions */
+    kh_value(h, it) = value;
+  } else if (kh_value(h, it) & 1 && kh_value(h, it) != value) {
+    kh_value(h, it) = DEMUX_AMBIGUOUS;
+  }
+}
+
+/* 
+   Sample sheet: one sample per line, a name and its index separated
+   by white space; blank lines and lines starting with '#' are skipped.
+*/
+demux_t *demux_init(const char *fn) {
+  demux_t *d;
+  khash_t(idx) *h;
+  FILE *fp = fopen(fn, "r");
+  char line[1024], name[512], index[512], *p;
+  int i, n_line = 0, m = 0;
+  size_t j, b;
+
+  if (!fp) {
+    fprintf(stderr, "[%s] error: cannot open sample sheet '%s'.\n", __func__, fn);
+    exit(1);
+  }
+  d = calloc(1, sizeof(demux_t));
+  while (fgets(line, sizeof(line), fp)) {
+    n_line++;
+    if (sscanf(line, "%511s %511s", name, index) != 2 || name[0] == '#') {
+      if (sscanf(line, "%511s", name) == 1 && name[0] != '#') {
+	fprintf(stderr, "[%s] error: sample sheet line %d needs a name and an index.\n", __func__, n_line);
+	exit(1);
+      }
+      continue;
+    }
+    if (strchr(name, '/')) {
+      fprintf(stderr, "[%s] error: sample name '%s' cannot contain '/'.\n", __func__, name);
+      exit(1);
+    }
+    for (p = index; *p; p++) {
+      *p = toupper(*p);
+      if (!strchr(bases, *p) && *p != '+') {
+	fprintf(stderr, "[%s] error: index '%s' of sample '%s' is not a DNA sequence.\n", __func__, index, name);
+	exit(1);
+      }
+    }
+    if (d->n && strlen(index) != d->len) {
+      fprintf(stderr, "[%s] error: index '%s' of sample '%s' differs in length from the others.\n", __func__, index, name);
+      exit(1);
+    }
+    if (d->n == m) {
+      m = m ? m*2 : 16;
+      d->names = realloc(d->names, m*sizeof(char*));
+      d->index = realloc(d->index, m*sizeof(char*));
+    }
+    d->names[d->n] = strdup(name);
+    d->index[d->n++] = strdup(index);
+    d->len = strlen(index);
+  }
+  fclose(fp);
+  if (!d->n) {
+    fprintf(stderr, "[%s] error: no samples in '%s'.\n", __func__, fn);
+    exit(1);
+  }
+
+  h = kh_init(idx);
+  d->buf = malloc(d->len + 1);
+  for (i = 0; i < d->n; i++) {
+    if (kh_get(idx, h, d->index[i]) != kh_end(h) && !(kh_value(h, kh_get(idx, h, d->index[i])) & 1)) {
+      fprintf(stderr, "[%s] error: samples '%s' and '%s' have the same index.\n", __func__,
+	      d->names[kh_value(h, kh_get(idx, h, d->index[i]))/2], d->names[i]);
+      exit(1);
+    }
+    demux_put(h, d->index[i], i*2);
+    memcpy(d->buf, d->index[i], d->len + 1);
+    for (j = 0; j < d->len; j++) {
+      if (d->buf[j] == '+') continue;
+      for (b = 0; b < 5; b++) {
+	if (bases[b] == d->index[i][j]) continue;
+	d->buf[j] = bases[b];
+	demux_put(h, d->buf, i*2 + 1);
+      }
+      d->buf[j] = d->index[i][j];
+    }
+  }
+  d->h = h;
+  d->n_exact = calloc(d->n, sizeof(uint64_t));
+  d->n_mismatch = calloc(d->n, sizeof(uint64_t));
+  return d;
+}
+
+/* take the index from the read at off, not from the comment */
+void demux_use_read(demux_t *d, size_t off) {
+  d->from_read = 1;
+  d->off = off;
+}
+
+/* sample of a read, or -1 if it matches none (or more than one) */
+int demux_assign(demux_t *d, const char *seq, size_t seq_l, const char *comment, size_t comment_l) {
+  khash_t(idx) *h = d->h;
+  const char *s;
+  khiter_t it;
+  size_t i;
+  int v;
+
+  if (d->from_read) {
+    if (seq_l < d->off + d->len) return -1;
+    s = seq + d->off;
+  } else {
+    /* the index is the last field of the comment */
+    for (i = comment_l; i > 0 && comment[i-1] != ':'; i--);
+    if (!i || comment_l - i != d->len) return -1;
+    s = comment + i;
+  }
+  for (i = 0; i < d->len; i++) d->buf[i] = toupper(s[i]);
+  d->buf[d->len] = '\0';
+  it = kh_get(idx, h, d->buf);
+  if (it == kh_end(h) || (v = kh_value(h, it)) == DEMUX_AMBIGUOUS) return -1;
+  if (v & 1) d->n_mismatch[v/2]++;
+  else d->n_exact[v/2]++;
+  return v/2;
+}
+
+void demux_fprint(FILE *file, const demux_t *d, uint64_t n_undetermined) {
+  int i;
+  fprintf(file, "sample\tindex\treads\tone_mismatch\n");
+  for (i = 0; i < d->n; i++)
+    fprintf(file, "%s\t%s\t%llu\t%llu\n", d->names[i], d->index[i],
+	    (long long unsigned int) (d->n_exact[i] + d->n_mismatch[i]),
+	    (long long unsigned int) d->n_mismatch[i]);
+  fprintf(file, "undetermined\t-\t%llu\t0\n", (long long unsigned int) n_undetermined);
+}
+
+void demux_destroy(demux_t *d) {
+  khash_t(idx) *h = d->h;
+  khiter_t it;
+  int i;
+  for (it = kh_begin(h); it != kh_end(h); ++it)
+    if (kh_exist(h, it)) free((char *) kh_key(h, it));
+  kh_destroy(idx, h);
+  for (i = 0; i < d->n; i++) {
+    free(d->names[i]);
+    free(d->index[i]);
+  }
+  free(d->names);
+  free(d->index);
+  free(d->n_exact);
+  free(d->n_mismatch);
+  free(d->buf);
+  free(d);
+}
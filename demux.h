@@ -0,0 +1,40 @@
+#ifndef DEMUX_H
+#define DEMUX_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* 
+   Sample lookup by index (barcode) sequence, for statistics on
+   undemultiplexed runs. Every sample's index and all of its one-base
+   substitutions go into one hash up front, so looking up a read's
+   index is a single probe however many samples there are. A
+   substitution shared by two samples is ambiguous and matches
+   neither; an exact index always wins over a substitution.
+
+   The index comes from the end of a Casava 1.8 comment
+   ("1:N:0:ACGTACGT", or "...:ACGTACGT+GGTTAACC" with two indices), or
+   from a fixed offset in the read itself.
+*/
+
+#define DEMUX_AMBIGUOUS (-1) /* odd, like a substitution */
+
+typedef struct {
+  int n; /* samples */
+  char **names, **index;
+  uint64_t *n_exact, *n_mismatch; /* reads assigned per sample */
+  size_t len; /* index length, the same for all samples */
+  int from_read; /* index at off in the read, rather than the comment */
+  size_t off;
+  char *buf; /* index being looked up */
+  void *h; /* index or substitution -> sample*2 + mismatched */
+} demux_t;
+
+demux_t *demux_init(const char *fn);
+void demux_use_read(demux_t *d, size_t off);
+int demux_assign(demux_t *d, const char *seq, size_t seq_l, const char *comment, size_t comment_l);
+void demux_fprint(FILE *file, const demux_t *d, uint64_t n_undetermined);
+void demux_destroy(demux_t *d);
+
+#endif
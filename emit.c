@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "emit.h"
+
+/* 
+   Each side stores its own index and then loads the other's. With
+   both sequentially consistent, a side about to sleep and the side
+   moving the ring out of that state cannot both miss each other; the
+   check is repeated under the lock, which the waker takes to signal.
+*/
+static void emit_wake(emitter_t *e, pthread_cond_t *cv) {
+  pthread_mutex_lock(&e->lock);
+  pthread_cond_signal(cv);
+  pthread_mutex_unlock(&e->lock);
+}
+
+static void *emit_writer(void *data) {
+  emitter_t *e = data;
+  uint64_t tail = e->tail, head;
+  for (;;) {
+    head = __atomic_load_n(&e->head, __ATOMIC_SEQ_CST);
+    if (tail == head) {
+      pthread_mutex_lock(&e->lock);
+      /* done is set after the last publish, so recheck head */
+      while (tail == (head = __atomic_load_n(&e->head, __ATOMIC_SEQ_CST)) && !e->done)
+	pthread_cond_wait(&e->more, &e->lock);
+      pthread_mutex_unlock(&e->lock);
+      if (tail == head) break;
+    }
+    for (; tail != head; tail++) {
+      uio_write(e->w, e->slots[tail % e->n_slots].s, e->slots[tail % e->n_slots].l);
+      e->slots[tail % e->n_slots].l = 0;
+      __atomic_store_n(&e->tail, tail + 1, __ATOMIC_SEQ_CST);
+      if (__atomic_load_n(&e->head, __ATOMIC_SEQ_CST) - tail == e->n_slots) emit_wake(e, &e->room);
+    }
+  }
+  uio_wclose(e->w);
+  return NULL;
+}
+
+emitter_t *emit_init(int fd, unsigned n_slots, size_t batch_size) {
+  emitter_t *e = calloc(1, sizeof(emitter_t));
+  unsigned i;
+  e->w = uio_wopen(fd);
+  e->n_slots = n_slots;
+  e->batch_size = batch_size;
+  e->slots = calloc(n_slots, sizeof(emit_batch_t));
+  for (i = 0; i < n_slots; i++) {
+    e->slots[i].m = batch_size;
+    e->slots[i].s = malloc(batch_size);
+  }
+  pthread_mutex_init(&e->lock, NULL);
+  pthread_cond_init(&e->more, NULL);
+  pthread_cond_init(&e->room, NULL);
+  if (pthread_create(&e->tid, NULL, emit_writer, e)) {
+    fprintf(stderr, "[%s] error: cannot start the writer thread.\n", __func__);
+    exit(1);
+  }
+  return e;
+}
+
+/* wait until the slot at head is free */
+static emit_batch_t *emit_slot(emitter_t *e) {
+  if (!e->has_slot) {
+    if (e->head - __atomic_load_n(&e->tail, __ATOMIC_SEQ_CST) >= e->n_slots) {
+      pthread_mutex_lock(&e->lock);
+      while (e->head - __atomic_load_n(&e->tail, __ATOMIC_SEQ_CST) >= e->n_slots)
+	pthread_cond_wait(&e->room, &e->lock);
+      pthread_mutex_unlock(&e->lock);
+    }
+    e->has_slot = 1;
+  }
+  return &e->slots[e->head % e->n_slots];
+}
+
+static void emit_publish(emitter_t *e) {
+  uint64_t head = e->head;
+  e->has_slot = 0;
+  __atomic_store_n(&e->head, head + 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&e->tail, __ATOMIC_SEQ_CST) == head) emit_wake(e, &e->more);
+}
+
+void emit_write(emitter_t *e, const char *p, size_t n) {
+  emit_batch_t *b = emit_slot(e);
+  if (b->l + n > b->m) {
+    b->m = b->l + n;
+    b->s = realloc(b->s, b->m);
+  }
+  memcpy(b->s + b->l, p, n);
+  b->l += n;
+  if (b->l >= e->batch_size) emit_publish(e);
+}
+
+void emit_putc(emitter_t *e, int c) {
+  char ch = c;
+  emit_write(e, &ch, 1);
+}
+
+/* publish the last partial batch and wait for the writer */
+void emit_destroy(emitter_t *e) {
+  unsigned i;
+  if (!e) return;
+  if (e->has_slot) emit_publish(e);
+  pthread_mutex_lock(&e->lock);
+  e->done = 1;
+  pthread_cond_signal(&e->more);
+  pthread_mutex_unlock(&e->lock);
+  pthread_join(e->tid, NULL);
+  pthread_mutex_destroy(&e->lock);
+  pthread_cond_destroy(&e->more);
+  pthread_cond_destroy(&e->room);
+  for (i = 0; i < e->n_slots; i++) free(e->slots[i].s);
+  free(e->slots);
+  free(e);
+}
@@ -0,0 +1,43 @@
+#ifndef EMIT_H
+#define EMIT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "uio.h"
+
+/* 
+   Asynchronous output for -e. Records are appended to batches in a
+   fixed ring; a writer thread drains full batches to the file
+   descriptor through uio, so statistics keep accumulating while a slow consumer
+   blocks the write. The ring has a single producer and a single
+   consumer and needs no locks: each side only advances its own index.
+   A side with nothing to do sleeps on a condition variable, and is
+   woken only when the ring leaves the state it is waiting on (empty
+   for the writer, full for the producer).
+*/
+
+typedef struct {
+  size_t l, m;
+  char *s;
+} emit_batch_t;
+
+typedef struct {
+  uio_writer_t *w;
+  unsigned n_slots;
+  size_t batch_size;
+  emit_batch_t *slots;
+  uint64_t head; /* next slot to fill; written by the producer */
+  uint64_t tail; /* next slot to write; written by the writer */
+  int done, has_slot;
+  pthread_t tid;
+  pthread_mutex_t lock; /* only for sleeping and waking */
+  pthread_cond_t more, room;
+} emitter_t;
+
+emitter_t *emit_init(int fd, unsigned n_slots, size_t batch_size);
+void emit_write(emitter_t *e, const char *p, size_t n);
+void emit_putc(emitter_t *e, int c);
+void emit_destroy(emitter_t *e);
+
+#endif
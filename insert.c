@@ -0,0 +1,161 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "spectrum.h"
+#include "insert.h"
+
+insert_t *insert_init(void) {
+  return calloc(1, sizeof(insert_t));
+}
+
+static void insert_reserve(insert_t *ins, size_t len) {
+  size_t n = len/64 + 2, i;
+  if (n <= ins->m_words) return;
+  ins->m_words = n;
+  for (i = 0; i < 3; i++) {
+    ins->a[i] = realloc(ins->a[i], n*sizeof(uint64_t));
+    ins->b[i] = realloc(ins->b[i], n*sizeof(uint64_t));
+  }
+}
+
+/* bit planes of a read; the spare word past the end stays zero */
+static void insert_planes(uint64_t **p, const char *s, size_t l, int revcomp) {
+  size_t i, n = l/64 + 2;
+  uint64_t c;
+  for (i = 0; i < 3; i++) memset(p[i], 0, n*sizeof(uint64_t));
+  for (i = 0; i < l; i++) {
+    c = seq_nt4_table[(unsigned char) (revcomp ? s[l-1-i] : s[i])];
+    if (c > 3) {
+      p[2][i>>6] |= 1ULL << (i & 63);
+      continue;
+    }
+    if (revcomp) c = 3 - c;
+    p[0][i>>6] |= (c & 1) << (i & 63);
+    p[1][i>>6] |= (c >> 1) << (i & 63);
+  }
+}
+
+/* 64 bits of a plane starting at bit pos */
+static inline uint64_t plane_get(const uint64_t *w, size_t pos) {
+  size_t i = pos >> 6;
+  unsigned s = pos & 63;
+  return s ? w[i] >> s | w[i+1] << (64 - s) : w[i];
+}
+
+/* mismatches (or N) over ov bases from sa in a and sb in b, stopping once past max */
+static unsigned insert_diff(const insert_t *ins, size_t sa, size_t sb, size_t ov, unsigned max) {
+  unsigned d = 0;
+  size_t j;
+  uint64_t x;
+  for (j = 0; j < ov && d <= max; j += 64) {
+    x = (plane_get(ins->a[0], sa + j) ^ plane_get(ins->b[0], sb + j))
+      | (plane_get(ins->a[1], sa + j) ^ plane_get(ins->b[1], sb + j))
+      | plane_get(ins->a[2], sa + j) | plane_get(ins->b[2], sb + j);
+    if (ov - j < 64) x &= (1ULL << (ov - j)) - 1;
+    d += __builtin_popcountll(x);
+  }
+  return d;
+}
+
+/* 2-bit k-mer of b at pos, or UINT64_MAX if it has an N */
+static uint64_t seed_at(const char *r2, size_t l2, size_t pos) {
+  uint64_t x = 0, c;
+  size_t i;
+  for (i = pos; i < pos + INSERT_K; i++) {
+    c = seq_nt4_table[(unsigned char) r2[l2-1-i]];
+    if (c > 3) return UINT64_MAX;
+    x = x << 2 | (3 - c);
+  }
+  return x;
+}
+
+void insert_add(insert_t *ins, const char *r1, size_t l1, const char *r2, size_t l2) {
+  const uint64_t mask = (1ULL << 2*INSERT_K) - 1;
+  uint64_t seeds[INSERT_SEEDS], x = 0, c;
+  long pos[INSERT_SEEDS], cand[8], d = 0;
+  size_t i, len = 0, sa, sb, ov, best_ov = 0, insert;
+  unsigned j, k, n_cand = 0, max, diff, best_diff = 0;
+  int found = 0;
+
+  ins->n_pairs++;
+  if (l1 < INSERT_K || l2 < INSERT_K) return;
+
+  /* seeds spread along b, from its start (long inserts) to its end (short inserts) */
+  for (j = 0; j < INSERT_SEEDS; j++) {
+    pos[j] = (long) (l2 - INSERT_K)*j/(INSERT_SEEDS - 1);
+    seeds[j] = seed_at(r2, l2, pos[j]);
+  }
+  for (i = 0; i < l1; i++) {
+    c = seq_nt4_table[(unsigned char) r1[i]];
+    if (c > 3) {
+      len = 0;
+      continue;
+    }
+    x = (x << 2 | c) & mask;
+    if (++len < INSERT_K) continue;
+    for (j = 0; j < INSERT_SEEDS; j++) {
+      if (x != seeds[j] || n_cand == 8) continue;
+      d = (long) (i + 1 - INSERT_K) - pos[j];
+      for (k = 0; k < n_cand && cand[k] != d; k++);
+      if (k == n_cand) cand[n_cand++] = d;
+    }
+  }
+  if (!n_cand) return;
+
+  insert_reserve(ins, l1 > l2 ? l1 : l2);
+  insert_planes(ins->a, r1, l1, 0);
+  insert_planes(ins->b, r2, l2, 1);
+  for (j = 0; j < n_cand; j++) {
+    /* b[i] lines up with a[i + d] */
+    sa = cand[j] > 0 ? cand[j] : 0;
+    sb = cand[j] < 0 ? -cand[j] : 0;
+    ov = l1 - sa < l2 - sb ? l1 - sa : l2 - sb;
+    max = ov*INSERT_MAX_DIFF;
+    diff = insert_diff(ins, sa, sb, ov, max);
+    if (diff > max) continue;
+    if (!found || diff*best_ov < best_diff*ov || (diff*best_ov == best_diff*ov && ov > best_ov)) {
+      found = 1;
+      best_diff = diff;
+      best_ov = ov;
+      d = cand[j];
+    }
+  }
+  if (!found) return;
+
+  insert = d + l2;
+  ins->n_overlap++;
+  if (insert < l1 || insert < l2) ins->n_through++;
+  if (insert >= ins->m_hist) {
+    i = ins->m_hist;
+    ins->m_hist = insert + 1 > 2*i ? insert + 1 : 2*i;
+    ins->hist = realloc(ins->hist, ins->m_hist*sizeof(uint64_t));
+    memset(ins->hist + i, 0, (ins->m_hist - i)*sizeof(uint64_t));
+  }
+  ins->hist[insert]++;
+}
+
+void insert_fprint(FILE *file, const insert_t *ins) {
+  uint64_t n = 0, median = 0;
+  size_t i;
+  fprintf(file, "insert\tpairs\n");
+  for (i = 0; i < ins->m_hist; i++) {
+    if (!ins->hist[i]) continue;
+    fprintf(file, "%llu\t%llu\n", (long long unsigned int) i, (long long unsigned int) ins->hist[i]);
+    if (n < (ins->n_overlap + 1)/2 && (n += ins->hist[i]) >= (ins->n_overlap + 1)/2) median = i;
+  }
+  fprintf(stderr, "[%s] %llu pairs: %llu overlap (median insert %llu), %llu (%.2f%%) read through into the adapter\n", __func__,
+	  (long long unsigned int) ins->n_pairs, (long long unsigned int) ins->n_overlap,
+	  (long long unsigned int) median, (long long unsigned int) ins->n_through,
+	  ins->n_pairs ? 100.0*ins->n_through/ins->n_pairs : 0);
+}
+
+void insert_destroy(insert_t *ins) {
+  unsigned i;
+  if (!ins) return;
+  for (i = 0; i < 3; i++) {
+    free(ins->a[i]);
+    free(ins->b[i]);
+  }
+  free(ins->hist);
+  free(ins);
+}
@@ -0,0 +1,35 @@
+#ifndef INSERT_H
+#define INSERT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* 
+   Insert sizes of read pairs from the overlap of the two mates,
+   without an aligner. A few k-mers of the reverse-complemented second
+   mate seed candidate offsets against the first, and each candidate
+   is checked with a bit-parallel Hamming distance: both reads are
+   held as bit planes (low base bit, high base bit, non-ACGT), so 64
+   bases are compared with a few XORs and a popcount. Pairs whose
+   insert is shorter than a read have read through into the adapter.
+*/
+
+#define INSERT_K 12 /* seed length, and the shortest overlap */
+#define INSERT_SEEDS 8
+#define INSERT_MAX_DIFF 0.1 /* mismatches allowed per overlapping base */
+
+typedef struct {
+  uint64_t n_pairs, n_overlap, n_through;
+  uint64_t *hist; /* pairs by insert size */
+  size_t m_hist;
+  uint64_t *a[3], *b[3]; /* bit planes of the first mate and of the reverse complement of the second */
+  size_t m_words;
+} insert_t;
+
+insert_t *insert_init(void);
+void insert_add(insert_t *ins, const char *r1, size_t l1, const char *r2, size_t l2);
+void insert_fprint(FILE *file, const insert_t *ins);
+void insert_destroy(insert_t *ins);
+
+#endif
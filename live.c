@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "live.h"
+
+live_t *live_open(const char *fn) {
+  live_t *lv;
+  void *p;
+  int fd = open(fn, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0 || ftruncate(fd, sizeof(live_page_t)) < 0) {
+    fprintf(stderr, "[%s] error: cannot create '%s': %s\n", __func__, fn, strerror(errno));
+    if (fd >= 0) close(fd);
+    return NULL;
+  }
+  p = mmap(NULL, sizeof(live_page_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    fprintf(stderr, "[%s] error: cannot map '%s': %s\n", __func__, fn, strerror(errno));
+    return NULL;
+  }
+  lv = calloc(1, sizeof(live_t));
+  lv->page = p;
+  lv->page->version = LIVE_VERSION;
+  memcpy(lv->page->magic, LIVE_MAGIC, 4);
+  return lv;
+}
+
+void live_publish(live_t *lv, const live_stats_t *st) {
+  if (!lv) return;
+  /* odd while writing; the fence keeps the copy after the mark */
+  __atomic_store_n(&lv->page->seq, ++lv->seq, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  memcpy(&lv->page->st, st, sizeof(live_stats_t));
+  __atomic_store_n(&lv->page->seq, ++lv->seq, __ATOMIC_RELEASE);
+}
+
+/* the last snapshot stays in the file for late readers */
+void live_close(live_t *lv) {
+  if (!lv) return;
+  munmap(lv->page, sizeof(live_page_t));
+  free(lv);
+}
+
+/* 0 on success */
+int live_peek(const char *fn, live_stats_t *st) {
+  live_page_t *page;
+  uint64_t s1, s2;
+  struct stat sb;
+  void *p;
+  int fd = open(fn, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "[%s] error: cannot open '%s': %s\n", __func__, fn, strerror(errno));
+    return 1;
+  }
+  if (fstat(fd, &sb) < 0 || sb.st_size < sizeof(live_page_t)) {
+    fprintf(stderr, "[%s] error: '%s' is not a seqqs live file\n", __func__, fn);
+    close(fd);
+    return 1;
+  }
+  p = mmap(NULL, sizeof(live_page_t), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    fprintf(stderr, "[%s] error: cannot map '%s': %s\n", __func__, fn, strerror(errno));
+    return 1;
+  }
+  page = p;
+  if (memcmp(page->magic, LIVE_MAGIC, 4) || page->version != LIVE_VERSION) {
+    fprintf(stderr, "[%s] error: '%s' is not a seqqs live file\n", __func__, fn);
+    munmap(p, sizeof(live_page_t));
+    return 1;
+  }
+  for (;;) {
+    s1 = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE);
+    if (s1 & 1) {
+      sched_yield();
+      continue;
+    }
+    memcpy(st, &page->st, sizeof(live_stats_t));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    s2 = __atomic_load_n(&page->seq, __ATOMIC_RELAXED);
+    if (s1 == s2) break;
+  }
+  munmap(p, sizeof(live_page_t));
+  return 0;
+}
+
+void live_fprint(FILE *fp, const live_stats_t *st) {
+  unsigned i;
+  fprintf(fp, "state\t%s\n", st->done ? "done" : "running");
+  fprintf(fp, "elapsed\t%.1f\n", st->elapsed);
+  fprintf(fp, "reads_per_sec\t%.0f\n", st->reads_per_sec);
+  fprintf(fp, "bytes_in\t%llu\n", (long long unsigned int) st->bytes_in);
+  if (st->size_in)
+    fprintf(fp, "size_in\t%llu\nprogress\t%.1f%%\n", (long long unsigned int) st->size_in,
+	    100.0*st->bytes_in/st->size_in);
+  for (i = 0; i < st->n_sets && i < LIVE_MAX_SETS; i++) {
+    const live_set_t *s = &st->sets[i];
+    const char *sfx = st->n_sets > 1 ? (i ? "_2" : "_1") : "";
+    fprintf(fp, "reads%s\t%llu\n", sfx, (long long unsigned int) s->reads);
+    fprintf(fp, "sampled_reads%s\t%llu\n", sfx, (long long unsigned int) s->sampled);
+    fprintf(fp, "bases%s\t%llu\n", sfx, (long long unsigned int) s->bases);
+    fprintf(fp, "positions%s\t%llu\n", sfx, (long long unsigned int) s->rows);
+    if (s->converged_at)
+      fprintf(fp, "converged_at%s\t%llu\n", sfx, (long long unsigned int) s->converged_at);
+  }
+}
@@ -0,0 +1,55 @@
+#ifndef LIVE_H
+#define LIVE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* 
+   Live statistics for monitoring a running seqqs. The writer maps a
+   small file (ideally on /dev/shm) and periodically copies a snapshot
+   of its counters into it, guarded by a seqlock: the sequence number
+   is odd while the snapshot is being written, so readers retry until
+   they see the same even number before and after their copy. Neither
+   side takes a lock or makes a system call to publish or read.
+*/
+
+#define LIVE_MAGIC "SQLV"
+#define LIVE_VERSION 1
+#define LIVE_MAX_SETS 2
+
+typedef struct {
+  uint64_t reads, sampled, bases;
+  uint64_t rows; /* positions (or bins) seen so far */
+  uint64_t converged_at;
+} live_set_t;
+
+typedef struct {
+  uint64_t done; /* 1 once the input is exhausted */
+  uint64_t n_sets;
+  uint64_t bytes_in; /* input bytes consumed, before decompression */
+  uint64_t size_in; /* input size, or 0 if not known (pipes) */
+  double elapsed; /* seconds since the start */
+  double reads_per_sec; /* since the previous snapshot */
+  live_set_t sets[LIVE_MAX_SETS];
+} live_stats_t;
+
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint64_t seq;
+  live_stats_t st;
+} live_page_t;
+
+typedef struct {
+  live_page_t *page;
+  uint64_t seq;
+} live_t;
+
+live_t *live_open(const char *fn);
+void live_publish(live_t *lv, const live_stats_t *st);
+void live_close(live_t *lv);
+
+int live_peek(const char *fn, live_stats_t *st);
+void live_fprint(FILE *fp, const live_stats_t *st);
+
+#endif
@@ -0,0 +1,34 @@
+#include <string.h>
+#include "names.h"
+
+/* length of the name without its mate tag; *mate is 1, 2, or 0 if none */
+size_t name_base(const char *name, size_t l, int *mate) {
+  *mate = 0;
+  if (l < 3 || (name[l-1] != '1' && name[l-1] != '2')) return l;
+  if (name[l-2] == '/'
+      || (name[l-2] == '.' && memchr(name, '.', l-2))) {
+    *mate = name[l-1] - '0';
+    return l - 2;
+  }
+  return l;
+}
+
+/* mate number from a Casava 1.8 comment ("1:N:0:..."), or 0 */
+int comment_mate(const char *comment, size_t l) {
+  if (l < 4 || (comment[0] != '1' && comment[0] != '2') || comment[1] != ':'
+      || (comment[2] != 'Y' && comment[2] != 'N') || comment[3] != ':')
+    return 0;
+  return comment[0] - '0';
+}
+
+int names_are_pair(const char *n1, size_t l1, const char *c1, size_t cl1,
+		   const char *n2, size_t l2, const char *c2, size_t cl2) {
+  int m1, m2;
+  l1 = name_base(n1, l1, &m1);
+  l2 = name_base(n2, l2, &m2);
+  if (l1 != l2 || memcmp(n1, n2, l1)) return 0;
+  /* a tag on the name takes precedence over the comment */
+  if (!m1) m1 = comment_mate(c1, c1 ? cl1 : 0);
+  if (!m2) m2 = comment_mate(c2, c2 ? cl2 : 0);
+  return m1 != 2 && m2 != 1;
+}
@@ -0,0 +1,25 @@
+#ifndef NAMES_H
+#define NAMES_H
+
+#include <stddef.h>
+
+/* 
+   Matching the names of the two reads of a pair, in place and without
+   allocating. Understood mate conventions:
+
+     read/1, read/2                   trailing tag
+     read 1:N:0:ACGT, read 2:N:0:ACGT  Casava 1.8+, mate in the comment
+     SRR001.7.1, SRR001.7.2           SRA, stripped only when the name
+				      has another '.' (SRR001.7 alone
+				      is a spot name)
+
+   Mate numbers, where given, must be 1 for the first read and 2 for
+   the second; a tag on the name wins over the comment.
+*/
+
+size_t name_base(const char *name, size_t l, int *mate);
+int comment_mate(const char *comment, size_t l);
+int names_are_pair(const char *n1, size_t l1, const char *c1, size_t cl1,
+		   const char *n2, size_t l2, const char *c2, size_t cl2);
+
+#endif
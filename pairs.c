@@ -1,4 +1,6 @@
 #include <assert.h>
+#include <ctype.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -6,24 +8,97 @@
 #include <limits.h>
 #include <unistd.h>
 #include <string.h>
+#include <getopt.h>
 #include "kseq.h"
+#include "uio.h"
+#include "names.h"
+#include "seqqs.h"
 
-KSEQ_INIT(gzFile, gzread)
+KSEQ_INIT(uio_cat_t*, uio_catread)
 
-static int is_interleaved_pair(const char *s1, const char *s2) {
-  while (*s1 && *s2) {
-    /* strings should be identical apart from trailing 1 or 2
-       (i.e. seq-a/1 and seq-a/2) 
+enum { OPT_STATS = 256 };
 
-       TODO: this checking is fairly simplistic, could be made better.
-    */
-    if (*s1 != *s2 && (*s1 != '1' && *s2 != '2'))
-      return 0;
-    s1++; s2++;
+/* 
+   --stats: seqqs statistics of the records as they pass through, one
+   set each for read 1, read 2, and (split only) unpaired reads,
+   written as if seqqs had been run with -p <prefix>_R1 and so on.
+*/
+typedef struct {
+  char *prefix;
+  qual_type qt;
+  qs_set_t *qs[3];
+} pair_stats_t;
+
+static const char *stats_sets[] = {"R1", "R2", "unpaired"};
+
+static int parse_qual(const char *s, qual_type *qt) {
+  if (strcmp(s, "illumina") == 0) *qt = ILLUMINA;
+  else if (strcmp(s, "solexa") == 0) *qt = SOLEXA;
+  else if (strcmp(s, "sanger") == 0) *qt = SANGER;
+  else {
+    fprintf(stderr, "Unknown quality type '%s'.\n", s);
+    return 1;
+  }
+  return 0;
+}
+
+static void stats_init(pair_stats_t *st, int n_sets) {
+  int i;
+  for (i = 0; i < 3; i++)
+    st->qs[i] = st->prefix && i < n_sets ? qs_init(st->qt, 0, 0) : NULL;
+}
+
+static inline void stats_add(pair_stats_t *st, int set, const kseq_t *s) {
+  const char *seq = s->seq.s, *qual = s->qual.s;
+  if (!st->qs[set]) return;
+  qs_update_reads(st->qs[set], 1, &seq, &s->seq.l, s->qual.l ? &qual : NULL, &s->qual.l, 0);
+}
+
+static FILE *stats_open(const char *prefix, const char *set, const char *name) {
+  FILE *fp;
+  char *fn = malloc(strlen(prefix) + strlen(set) + strlen(name) + 7);
+  sprintf(fn, "%s_%s_%s.txt", prefix, set, name);
+  if (!(fp = fopen(fn, "w"))) {
+    fprintf(stderr, "[%s] error: cannot open '%s'.\n", __func__, fn);
+    exit(1);
+  }
+  free(fn);
+  return fp;
+}
+
+static void stats_write(pair_stats_t *st) {
+  FILE *fp;
+  int i;
+  for (i = 0; i < 3; i++) {
+    if (!st->qs[i]) continue;
+    if (st->qt != NONE) {
+      qs_qm_fprint(fp = stats_open(st->prefix, stats_sets[i], "qual"), st->qs[i]);
+      fclose(fp);
+    }
+    qs_ntm_fprint(fp = stats_open(st->prefix, stats_sets[i], "nucl"), st->qs[i]);
+    fclose(fp);
+    qs_lm_fprint(fp = stats_open(st->prefix, stats_sets[i], "len"), st->qs[i]);
+    fclose(fp);
+    qs_summary_fprint(fp = stats_open(st->prefix, stats_sets[i], "summary"), st->qs[i]);
+    fclose(fp);
+    qs_destroy(st->qs[i]);
+  }
+}
+
+static int stats_option(pair_stats_t *st, int c) {
+  switch (c) {
+  case OPT_STATS: st->prefix = optarg; return 0;
+  case 'q': return parse_qual(optarg, &st->qt);
+  case 'f': st->qt = NONE; return 0;
   }
   return 1;
 }
 
+static const struct option stats_long[] = {
+  {"stats", required_argument, 0, OPT_STATS},
+  {0, 0, 0, 0}
+};
+
 static int usage() {
   fprintf(stderr, "\nInterleaves (pairs) and un-interleaves paired-end files");
   fprintf(stderr, "Usage <command> <arguments>\n\n");
@@ -32,95 +107,196 @@ static int usage() {
   return 1;
 }
 
-static void printstr(FILE *stream, const kstring_t *s, unsigned line_len)
+static void printstr(uio_writer_t *stream, const kstring_t *s, unsigned line_len)
 {
   /* from Heng's stk_printstr */
   if (line_len != UINT_MAX) {
     int i, rest = s->l;
     for (i = 0; i < s->l; i += line_len, rest -= line_len) {
-      fputc('\n', stream);
-      if (rest > line_len) fwrite(s->s + i, 1, line_len, stream);
-      else fwrite(s->s + i, 1, rest, stream);
+      uio_putc(stream, '\n');
+      if (rest > line_len) uio_write(stream, s->s + i, line_len);
+      else uio_write(stream, s->s + i, rest);
     }
-    fputc('\n', stream);
+    uio_putc(stream, '\n');
   } else {
-    fputc('\n', stream);
-    fputs(s->s, stream);
+    uio_putc(stream, '\n');
+    uio_write(stream, s->s, s->l);
   }
 }	
 
-void printseq(FILE *stream, const kseq_t *s, int line_len, int tag) {
+void printseq(uio_writer_t *stream, const kseq_t *s, int line_len, int tag) {
   /* from Heng's seqtk */
-  fputc(s->qual.l? '@' : '>', stream);
-  fputs(s->name.s, stream);
+  uio_putc(stream, s->qual.l? '@' : '>');
+  uio_write(stream, s->name.s, s->name.l);
   if (tag) {
-    fputc('/', stream); putc((char)(((int)'0')+tag), stream);
+    uio_putc(stream, '/'); uio_putc(stream, (char)(((int)'0')+tag));
   }
 
   if (s->comment.l) {
-    fputc(' ', stream); fputs(s->comment.s, stream);
+    uio_putc(stream, ' '); uio_write(stream, s->comment.s, s->comment.l);
   }
   printstr(stream, &s->seq, line_len);
   if (s->qual.l) {
-    fputc('+', stream);
+    uio_putc(stream, '+');
     printstr(stream, &s->qual, line_len);
   }
 }
 
 int join_usage() {
   fputs("\
-Usage:    pairs join [options] <in1.fq> <in2.fq>\n\n\
+Usage:    pairs join [options] <in1.fq>[,<in1.fq>...] <in2.fq>[,<in2.fq>...]\n\n\
 Options:  -t   tag interleaved pairs with '/1' and '/2' (before comment)\n\
           -s   error out when read names are different\n\
-Interleaves two paired-end files.\n\n", stderr);
+          --stats PREFIX  also write seqqs statistics of each mate, to\n\
+                          PREFIX_R1_*.txt and PREFIX_R2_*.txt\n\
+          -q   quality type for --stats: illumina, solexa, or sanger (default: sanger)\n\
+          -f   FASTA input, no qualities (with --stats)\n\n\
+Interleaves two paired-end files, or two matching comma-separated lists\n\
+of files, each read as one concatenated stream. Casava 1.8 file names\n\
+(<sample>_<index>_L<lane>_R<1|2>_<set>.fastq.gz) are checked up front:\n\
+each R1 file must be paired with the R2 file of the same lane and set,\n\
+and sets of a lane must be in increasing order.\n\n", stderr);
   return 1;
 }
 
+/* 
+   Split a Casava 1.8 file name, <sample>_<index>_L<lane>_R<read>_<set>
+   plus extensions, into the length of everything before "_R<read>_",
+   the read, and the set number. Returns 0 for other names.
+*/
+static int casava_name(const char *fn, size_t *stem, int *read, long *set) {
+  const char *base = strrchr(fn, '/'), *p, *q;
+  int found = 0;
+  base = base ? base + 1 : fn;
+  for (p = base; (p = strstr(p, "_R")); p++) {
+    if ((p[2] != '1' && p[2] != '2') || p[3] != '_' || !isdigit((unsigned char) p[4])) continue;
+    for (q = p + 4; isdigit((unsigned char) *q); q++);
+    if (*q && *q != '.') continue;
+    *stem = p - fn;
+    *read = p[2] - '0';
+    *set = strtol(p + 4, NULL, 10);
+    found = 1;
+  }
+  return found;
+}
+
+/* 
+   Check that lists of read 1 and read 2 files line up, when they have
+   Casava names; returns 1 after printing the first problem.
+*/
+static int check_lanes(char **fn1, char **fn2, int n) {
+  size_t stem[2], last_stem = 0;
+  int i, read[2], named[2];
+  long set[2], last_set = 0;
+  for (i = 0; i < n; i++) {
+    named[0] = casava_name(fn1[i], &stem[0], &read[0], &set[0]);
+    named[1] = casava_name(fn2[i], &stem[1], &read[1], &set[1]);
+    if (!named[0] || !named[1]) continue;
+    if (read[0] != 1 || read[1] != 2) {
+      fprintf(stderr, "[%s] error: '%s' should be read 1 and '%s' read 2.\n", __func__, fn1[i], fn2[i]);
+      return 1;
+    }
+    if (stem[0] != stem[1] || strncmp(fn1[i], fn2[i], stem[0]) || set[0] != set[1]) {
+      fprintf(stderr, "[%s] error: '%s' and '%s' are not from the same lane and set.\n", __func__, fn1[i], fn2[i]);
+      return 1;
+    }
+    if (i > 0 && stem[0] == last_stem && !strncmp(fn1[i], fn1[i-1], stem[0]) && set[0] <= last_set) {
+      fprintf(stderr, "[%s] error: '%s' is listed after '%s'; sets of a lane must be in increasing order.\n", __func__, fn1[i], fn1[i-1]);
+      return 1;
+    }
+    last_stem = stem[0];
+    last_set = set[0];
+  }
+  return 0;
+}
+
+/* split a comma-separated list in place */
+static char **split_list(char *s, int *n) {
+  char **fn = NULL, *p;
+  *n = 0;
+  for (p = strtok(s, ","); p; p = strtok(NULL, ",")) {
+    fn = realloc(fn, (*n + 1)*sizeof(char *));
+    fn[(*n)++] = p;
+  }
+  return fn;
+}
+
 int pairs_join(int argc, char *argv[]) {
-  gzFile fp[2];
+  uio_cat_t *fp[2];
+  uio_writer_t *out;
   kseq_t *ks[2];
-  int c, i, tag=0, strict=0, l[] = {0, 0};
-  while ((c = getopt(argc, argv, "ts")) >= 0) {
+  char **fn[2];
+  pair_stats_t st = {NULL, SANGER};
+  int c, i, tag=0, strict=0, l[] = {0, 0}, n_fn[2];
+  while ((c = getopt_long(argc, argv, "tsq:f", stats_long, NULL)) >= 0) {
     switch (c) {
     case 't': tag = 1; break;
     case 's': strict = 1; break;
-    default: return 1;
+    default: if (stats_option(&st, c)) return 1;
     }
   }
 
-  if (optind == argc) return join_usage();
+  if (optind + 2 > argc) return join_usage();
+
+  for (i = 0; i < 2; ++i) fn[i] = split_list(argv[optind + i], &n_fn[i]);
+  if (n_fn[0] != n_fn[1] || !n_fn[0]) {
+    fprintf(stderr, "[%s] error: %d read 1 files but %d read 2 files.\n", __func__, n_fn[0], n_fn[1]);
+    return 1;
+  }
+  if (check_lanes(fn[0], fn[1], n_fn[0])) return 1;
+  for (i = 0; i < 2*n_fn[0]; ++i) {
+    const char *f = fn[i/n_fn[0]][i%n_fn[0]];
+    if (strcmp(f, "-") && access(f, R_OK) < 0) {
+      fprintf(stderr, "[%s] error: cannot open '%s': %s.\n", __func__, f, strerror(errno));
+      return 1;
+    }
+  }
 
   for (i = 0; i < 2; ++i) {
-    fp[i] = gzopen(argv[optind + i], "r");
+    fp[i] = uio_catopen(fn[i], n_fn[i]);
     ks[i] = kseq_init(fp[i]);
   }
+  stats_init(&st, 2);
+  out = uio_wopen(fileno(stdout));
   for (;;) {
     for (i = 0; i < 2; ++i) l[i] = kseq_read(ks[i]);
     if (l[0] < 0 || l[1] < 0)
       break;
-    if (!is_interleaved_pair(ks[0]->name.s, ks[1]->name.s)) {
+    if (!names_are_pair(ks[0]->name.s, ks[0]->name.l, ks[0]->comment.s, ks[0]->comment.l,
+			ks[1]->name.s, ks[1]->name.l, ks[1]->comment.s, ks[1]->comment.l)) {
       fprintf(stderr, "[%s] warning: different sequence names: %s != %s\n", __func__, ks[0]->name.s, ks[1]->name.s);
       if (strict) return 1;
     }
    
-    for (i = 0; i < 2; ++i) printseq(stdout, ks[i], ks[i]->seq.l, tag ? i+1 : 0);
+    for (i = 0; i < 2; ++i) {
+      printseq(out, ks[i], ks[i]->seq.l, tag ? i+1 : 0);
+      stats_add(&st, i, ks[i]);
+    }
   }
+  uio_wclose(out);
   
   if (l[0] > 0 || l[1] > 0) {
     fprintf(stderr, "[%s] error: paired end files have differing numbers of reads.\n", __func__);
     exit(1);
   }
 
+  stats_write(&st);
   for (i = 0; i < 2; ++i) {
     kseq_destroy(ks[i]);
-    gzclose(fp[i]);
+    uio_catclose(fp[i]);
+    free(fn[i]);
   }
   return 0;
 }
 
 /* from seqtk.c */
 static void cpy_kstr(kstring_t *dst, const kstring_t *src) {
-  if (src->l == 0) return;
+  if (src->l == 0) {
+    /* an empty sequence or comment must not leave the last one behind */
+    dst->l = 0;
+    if (dst->s) dst->s[0] = '\0';
+    return;
+  }
   if (src->l + 1 > dst->m) {
     dst->m = src->l + 1;
     kroundup32(dst->m);
@@ -144,7 +320,11 @@ Options:  -n       not strict; won't error if names are not consistent (not reco
           -1 FILE  output file name for 1 reads\n\
           -2 FILE  output file name for 2 reads\n\
           -u FILE  output file name for unpaired reads\n\n\
-          -m INT   minimum length of reads, equal or shorter will go to unpaired\n\n\
+          -m INT   minimum length of reads, equal or shorter will go to unpaired\n\
+          --stats PREFIX  also write seqqs statistics of each output, to\n\
+                   PREFIX_R1_*.txt, PREFIX_R2_*.txt, and PREFIX_unpaired_*.txt\n\
+          -q TYPE  quality type for --stats: illumina, solexa, or sanger (default: sanger)\n\
+          -f       FASTA input, no qualities (with --stats)\n\n\
 Split interleaved reads into three files: paired-end 1, paired-end 2, and a file for \n\
 orphaned reads.\n\n\
 Orphaned/unpaired reads are determined by either an empty FASTQ sequence entry, \n\
@@ -155,22 +335,22 @@ except for optional trailing '/1' and '/2', and ignoring comments.\n", stderr);
 
 int pairs_split(int argc, char *argv[]) {
   kseq_t **seq, *tmp;
-  FILE *fpout[] = {NULL, NULL, NULL};
-  gzFile fp;
-  int c, l, i, strict=1, min_length=0;
+  uio_writer_t *fpout[] = {NULL, NULL, NULL};
+  uio_cat_t *fp;
+  int c, l, i, strict=1, min_length=0, mate;
   unsigned total[]={0, 0}, removed[]={0, 0}, both_removed = 0;
   unsigned is_empty[]={0, 0};
-  char *p, *tags[] = {"/1", "/2"};
-  while ((c = getopt(argc, argv, "1:2:u:n")) >= 0) {
+  pair_stats_t st = {NULL, SANGER};
+  while ((c = getopt_long(argc, argv, "1:2:u:nq:f", stats_long, NULL)) >= 0) {
     switch (c) {
     case '1': 
-      fpout[0] = fopen(optarg, "w");
+      fpout[0] = uio_wfopen(optarg);
       break;
     case '2':
-      fpout[1] = fopen(optarg, "w");
+      fpout[1] = uio_wfopen(optarg);
       break;
     case 'u':
-      fpout[2] = fopen(optarg, "w");
+      fpout[2] = uio_wfopen(optarg);
       break;
     case 'm': 
       min_length = atoi(optarg); 
@@ -178,7 +358,7 @@ int pairs_split(int argc, char *argv[]) {
       return 1;
       break;
     case 'n': strict = 0; break;
-    default: return 1;
+    default: if (stats_option(&st, c)) return 1;
     }
   }
 
@@ -191,11 +371,16 @@ int pairs_split(int argc, char *argv[]) {
     }
   }
 
-  fp = (strcmp(argv[optind], "-") == 0) ? gzdopen(fileno(stdin), "r") : gzopen(argv[optind], "r");
+  fp = uio_catopen(argv + optind, 1);
+  if (!fp) {
+    fprintf(stderr, "[%s] error: cannot open '%s'.\n", __func__, argv[optind]);
+    return 1;
+  }
   
   seq = calloc(2, sizeof(kseq_t*));
-  for (i = 0; i < 2; ++i) seq[i] = malloc(sizeof(kseq_t));
+  for (i = 0; i < 2; ++i) seq[i] = calloc(1, sizeof(kseq_t));
   tmp = kseq_init(fp);
+  stats_init(&st, 3);
   while ((l=kseq_read(tmp)) >= 0) {
     /* always read in chunks of two FASTX entries */
     cpy_kseq(seq[0], tmp);
@@ -203,19 +388,21 @@ int pairs_split(int argc, char *argv[]) {
     if (l < 0) break;
     cpy_kseq(seq[1], tmp);
 
+    if (!names_are_pair(seq[0]->name.s, seq[0]->name.l, seq[0]->comment.s, seq[0]->comment.l,
+			seq[1]->name.s, seq[1]->name.l, seq[1]->comment.s, seq[1]->comment.l)) {
+      fprintf(stderr, "[%s] warning: interleaved reads names differ '%s' != '%s'\n", __func__, seq[0]->name.s, seq[1]->name.s);
+      if (strict) return 1;
+    }
+
     for (i = 0; i < 2; ++i) {
       /* remove /1 and /2 tags */
-      p = strstr(seq[i]->name.s, tags[i]);
-      if (p) {
-	strncpy(p, "\0", 1);
+      size_t b = name_base(seq[i]->name.s, seq[i]->name.l, &mate);
+      if (mate && seq[i]->name.s[b] == '/') {
+	seq[i]->name.s[b] = '\0';
+	seq[i]->name.l = b;
       }
     }
 
-    if (strcmp(seq[0]->name.s, seq[1]->name.s) != 0) {
-      fprintf(stderr, "[%s] warning: interleaved reads names differ '%s' != '%s'\n", __func__, seq[0]->name.s, seq[1]->name.s);
-      if (strict) return 1;
-    }
-
     /* deal with unpaired cases (either no seq or single 'N') */
     for (i = 0; i < 2; ++i) {
       is_empty[i] = seq[i]->seq.l <= min_length || strcmp(seq[i]->seq.s, "N") == 0;
@@ -224,14 +411,17 @@ int pairs_split(int argc, char *argv[]) {
     }
     
     if (!is_empty[0] && !is_empty[1]) {
-      for (i = 0; i < 2; i++)      
+      for (i = 0; i < 2; i++) {
 	printseq(fpout[i], seq[i], seq[i]->seq.l, 0);
+	stats_add(&st, i, seq[i]);
+      }
     } else if (is_empty[0] && is_empty[1]) {
       both_removed += 1;
       continue;
     } else {
       i = is_empty[0] ? 1 : 0;
       printseq(fpout[2], seq[i], seq[i]->seq.l, 0);
+      stats_add(&st, 2, seq[i]);
     }
   }
   if (total[0] != total[1]) {
@@ -239,6 +429,10 @@ int pairs_split(int argc, char *argv[]) {
     return 1;
   }
   fprintf(stderr, "totals: %u %u\nremoved: %u %u\n", total[0], total[1], removed[0], removed[1]);
+  for (i = 0; i < 3; ++i) uio_wclose(fpout[i]);
+  stats_write(&st);
+  kseq_destroy(tmp);
+  uio_catclose(fp);
   return 0;
 }
 
@@ -0,0 +1,403 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include "pdec.h"
+
+enum { JOB_FREE, JOB_QUEUED, JOB_BUSY, JOB_DONE };
+
+#define ZSTD_MAGIC 0xfd2fb528U
+
+static inline unsigned le16(const unsigned char *p) { return p[0] | p[1] << 8; }
+static inline uint32_t le32(const unsigned char *p) {
+  return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+static void *grow(unsigned char **s, size_t *m, size_t n) {
+  if (*m < n) {
+    *m = n < 2 * *m ? 2 * *m : n;
+    *s = realloc(*s, *m);
+  }
+  return *s;
+}
+
+/* size of the block whose header (through the extra field) is at p, or 0 if it is not BGZF */
+static size_t block_size(const unsigned char *p, size_t n) {
+  size_t i, end;
+  if (n < 12 || p[0] != 31 || p[1] != 139 || p[2] != 8 || !(p[3] & 4)) return 0;
+  end = 12 + le16(p + 10);
+  if (end > n) end = n;
+  for (i = 12; i + 4 <= end; i += 4 + le16(p + i + 2))
+    if (p[i] == 'B' && p[i+1] == 'C' && le16(p + i + 2) == 2 && i + 6 <= end)
+      return le16(p + i + 4) + 1;
+  return 0;
+}
+
+int pdec_bgzf_check(const unsigned char *p, size_t n) {
+  return block_size(p, n) > 0;
+}
+
+/* whether p starts with a whole zstd frame, so later frames are likely small enough to split */
+int pdec_zstd_check(const unsigned char *p, size_t n) {
+#ifdef HAVE_ZSTD
+  return n >= 4 && le32(p) == ZSTD_MAGIC && !ZSTD_isError(ZSTD_findFrameCompressedSize(p, n));
+#else
+  return 0;
+#endif
+}
+
+/* appends up to n bytes of compressed input to j; short only at end of input */
+static size_t take(pdec_t *d, pdec_job_t *j, size_t n) {
+  const char *p;
+  size_t got = 0, k;
+  grow(&j->in, &j->in_m, j->in_l + n);
+  while (got < n) {
+    if (!d->n) {
+      if (d->eof || !(d->n = d->next(d->src, &p))) {
+	d->eof = 1;
+	break;
+      }
+      d->p = (const unsigned char *) p;
+    }
+    k = d->n < n - got ? d->n : n - got;
+    memcpy(j->in + j->in_l, d->p, k);
+    d->p += k;
+    d->n -= k;
+    j->in_l += k;
+    got += k;
+  }
+  return got;
+}
+
+/* cuts one piece out of the input into j: 1 if cut, 0 at end of input, -1 if truncated */
+static int cut_bgzf(pdec_t *d, pdec_job_t *j) {
+  size_t start = j->in_l, got, xlen, bsize;
+  if (!(got = take(d, j, 12))) return 0;
+  if (got < 12) return -1;
+  xlen = le16(j->in + start + 10);
+  if (take(d, j, xlen) < xlen) return -1;
+  bsize = block_size(j->in + start, 12 + xlen);
+  if (!bsize || bsize < 12 + xlen + 8) {
+    fprintf(stderr, "[%s] error: input is not BGZF (a block has no size).\n", __func__);
+    exit(1);
+  }
+  return take(d, j, bsize - 12 - xlen) < bsize - 12 - xlen ? -1 : 1;
+}
+
+/* walks a zstd frame by its block headers, or skips a skippable frame */
+static int cut_zstd(pdec_t *d, pdec_job_t *j) {
+  static const unsigned did_size[4] = {0, 1, 2, 4}, fcs_size[4] = {0, 2, 4, 8};
+  size_t start = j->in_l, got, n;
+  unsigned fhd, bh;
+  uint32_t magic;
+
+  if (!(got = take(d, j, 4))) return 0;
+  if (got < 4) return -1;
+  magic = le32(j->in + start);
+  if ((magic & 0xfffffff0U) == 0x184d2a50U) {
+    if (take(d, j, 4) < 4) return -1;
+    n = le32(j->in + j->in_l - 4);
+    return take(d, j, n) < n ? -1 : 1;
+  }
+  if (magic != ZSTD_MAGIC) {
+    fprintf(stderr, "[%s] error: input is not zstd (bad frame magic).\n", __func__);
+    exit(1);
+  }
+  if (take(d, j, 1) < 1) return -1;
+  fhd = j->in[j->in_l - 1];
+  /* window descriptor unless single segment, dictionary id, content size */
+  n = !(fhd & 0x20) + did_size[fhd & 3] + ((fhd >> 6) ? fcs_size[fhd >> 6] : (fhd & 0x20) != 0);
+  if (take(d, j, n) < n) return -1;
+  do {
+    if (take(d, j, 3) < 3) return -1;
+    bh = j->in[j->in_l - 3] | j->in[j->in_l - 2] << 8 | j->in[j->in_l - 1] << 16;
+    if ((bh >> 1 & 3) == 3) {
+      fprintf(stderr, "[%s] error: corrupt zstd input (reserved block type).\n", __func__);
+      exit(1);
+    }
+    n = (bh >> 1 & 3) == 1 ? 1 : bh >> 3; /* an RLE block is one byte */
+    if (take(d, j, n) < n) return -1;
+  } while (!(bh & 1));
+  if (fhd & 4 && take(d, j, 4) < 4) return -1;
+  return 1;
+}
+
+/* cuts pieces into j until it holds a job's worth; returns 0 once there are none */
+static int fill_job(pdec_t *d, pdec_job_t *j) {
+  size_t last = 0;
+  int ret = 1;
+  j->in_l = 0;
+  j->c_off = d->c_in;
+  while (j->in_l < PDEC_JOB_SIZE
+	 && (ret = d->fmt == PDEC_BGZF ? cut_bgzf(d, j) : cut_zstd(d, j)) > 0)
+    last = j->in_l;
+  if (ret < 0) {
+    fprintf(stderr, "[%s] warning: truncated %s input.\n", __func__, d->fmt == PDEC_BGZF ? "BGZF" : "zstd");
+    d->eof = 1;
+    d->n = 0;
+    j->in_l = last; /* the partial piece is dropped */
+  }
+  d->c_in += j->in_l;
+  return j->in_l > 0;
+}
+
+static int decode_bgzf(z_stream *zs, pdec_job_t *j) {
+  const unsigned char *p;
+  size_t off, hdr, bsize, isize, total;
+
+  for (off = total = 0; off < j->in_l; off += bsize) {
+    bsize = block_size(j->in + off, j->in_l - off);
+    if ((isize = le32(j->in + off + bsize - 4)) > BGZF_MAX_BLOCK) return -1;
+    total += isize;
+  }
+  grow(&j->out, &j->out_m, total);
+  j->out_l = 0;
+  for (off = 0; off < j->in_l; off += bsize) {
+    p = j->in + off;
+    hdr = 12 + le16(p + 10);
+    bsize = block_size(p, hdr);
+    isize = le32(p + bsize - 4);
+    inflateReset(zs);
+    zs->next_in = (unsigned char *) p + hdr;
+    zs->avail_in = bsize - hdr - 8;
+    zs->next_out = j->out + j->out_l;
+    zs->avail_out = isize;
+    if (inflate(zs, Z_FINISH) != Z_STREAM_END || zs->avail_out) return -1;
+    if (crc32(crc32(0L, Z_NULL, 0), j->out + j->out_l, isize) != le32(p + bsize - 8)) return -1;
+    j->out_l += isize;
+  }
+  return 0;
+}
+
+#ifdef HAVE_ZSTD
+/* the decoded size of a job's frames, if every frame records its own */
+static unsigned long long zstd_job_size(const pdec_job_t *j) {
+  unsigned long long total = 0, fs;
+  size_t off, fl;
+  for (off = 0; off < j->in_l; off += fl) {
+    fl = ZSTD_findFrameCompressedSize(j->in + off, j->in_l - off);
+    if (ZSTD_isError(fl)) return ZSTD_CONTENTSIZE_ERROR;
+    if ((le32(j->in + off) & 0xfffffff0U) == 0x184d2a50U) continue;
+    fs = ZSTD_getFrameContentSize(j->in + off, j->in_l - off);
+    if (fs == ZSTD_CONTENTSIZE_ERROR || fs == ZSTD_CONTENTSIZE_UNKNOWN) return fs;
+    total += fs;
+  }
+  return total;
+}
+
+static int decode_zstd(ZSTD_DCtx *dc, pdec_job_t *j) {
+  unsigned long long size = zstd_job_size(j);
+  ZSTD_inBuffer in = {j->in, j->in_l, 0};
+  ZSTD_outBuffer out;
+  size_t ret;
+
+  if (size == ZSTD_CONTENTSIZE_ERROR) return -1;
+  if (size != ZSTD_CONTENTSIZE_UNKNOWN) {
+    grow(&j->out, &j->out_m, size);
+    ret = ZSTD_decompressDCtx(dc, j->out, size, j->in, j->in_l);
+    j->out_l = ret;
+    return ZSTD_isError(ret) || ret != size ? -1 : 0;
+  }
+  /* frames without a content size are streamed into a growing buffer */
+  ZSTD_DCtx_reset(dc, ZSTD_reset_session_only);
+  grow(&j->out, &j->out_m, 4 * j->in_l);
+  j->out_l = 0;
+  for (;;) {
+    if (j->out_l == j->out_m) grow(&j->out, &j->out_m, 2 * j->out_m);
+    out.dst = j->out;
+    out.size = j->out_m;
+    out.pos = j->out_l;
+    ret = ZSTD_decompressStream(dc, &out, &in);
+    if (ZSTD_isError(ret)) return -1;
+    j->out_l = out.pos;
+    /* room left over means everything decodable has been flushed */
+    if (in.pos == in.size && out.pos < out.size) return 0;
+  }
+}
+#endif
+
+/* decodes queued jobs, oldest first, until stopped */
+static void *pdec_worker(void *data) {
+  pdec_t *d = data;
+  pdec_job_t *j;
+  z_stream zs;
+#ifdef HAVE_ZSTD
+  ZSTD_DCtx *dc = d->fmt == PDEC_ZSTD ? ZSTD_createDCtx() : NULL;
+#endif
+  uint64_t s;
+
+  memset(&zs, 0, sizeof(zs));
+  if (d->fmt == PDEC_BGZF && inflateInit2(&zs, -15) != Z_OK) {
+    fprintf(stderr, "[%s] error: cannot initialize zlib.\n", __func__);
+    exit(1);
+  }
+  pthread_mutex_lock(&d->lock);
+  while (!d->stop) {
+    for (j = NULL, s = d->taken; s < d->filled; s++)
+      if (d->jobs[s % d->n_jobs].state == JOB_QUEUED) {
+	j = &d->jobs[s % d->n_jobs];
+	break;
+      }
+    if (!j) {
+      pthread_cond_wait(&d->work, &d->lock);
+      continue;
+    }
+    j->state = JOB_BUSY;
+    pthread_mutex_unlock(&d->lock);
+#ifdef HAVE_ZSTD
+    if (d->fmt == PDEC_ZSTD) j->err = decode_zstd(dc, j);
+    else
+#endif
+      j->err = decode_bgzf(&zs, j);
+    pthread_mutex_lock(&d->lock);
+    __atomic_store_n(&j->state, JOB_DONE, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&d->done);
+  }
+  pthread_mutex_unlock(&d->lock);
+  if (d->fmt == PDEC_BGZF) inflateEnd(&zs);
+#ifdef HAVE_ZSTD
+  ZSTD_freeDCtx(dc);
+#endif
+  return NULL;
+}
+
+/* keeps every free job queued while there is input */
+static void queue_jobs(pdec_t *d) {
+  pdec_job_t *j;
+  while (!d->eof && d->filled - d->taken < d->n_jobs) {
+    j = &d->jobs[d->filled % d->n_jobs];
+    if (!fill_job(d, j)) break;
+    pthread_mutex_lock(&d->lock);
+    j->state = JOB_QUEUED;
+    d->filled++;
+    pthread_cond_signal(&d->work);
+    pthread_mutex_unlock(&d->lock);
+  }
+}
+
+/*
+   Decodes input from next(src), starting with the n bytes at p that
+   were already taken out of it (as when sniffing the format).
+*/
+pdec_t *pdec_open(int fmt, pdec_next_f next, void *src, const unsigned char *p, size_t n, int n_threads) {
+  pdec_t *d = calloc(1, sizeof(pdec_t));
+  unsigned i;
+  d->fmt = fmt;
+  d->next = next;
+  d->src = src;
+  d->p = p;
+  d->n = n;
+  d->n_threads = n_threads;
+  d->n_jobs = 2*n_threads + 2;
+  d->jobs = calloc(d->n_jobs, sizeof(pdec_job_t));
+  pthread_mutex_init(&d->lock, NULL);
+  pthread_cond_init(&d->work, NULL);
+  pthread_cond_init(&d->done, NULL);
+  d->workers = calloc(n_threads, sizeof(pthread_t));
+  for (i = 0; i < d->n_threads; i++)
+    if (pthread_create(&d->workers[i], NULL, pdec_worker, d)) {
+      fprintf(stderr, "[%s] error: cannot start the decoding threads.\n", __func__);
+      exit(1);
+    }
+  return d;
+}
+
+int pdec_read(pdec_t *d, void *buf, unsigned len) {
+  pdec_job_t *j;
+  unsigned n = 0, k;
+
+  while (n < len) {
+    queue_jobs(d);
+    if (d->taken == d->filled) break;
+    j = &d->jobs[d->taken % d->n_jobs];
+    if (__atomic_load_n(&j->state, __ATOMIC_ACQUIRE) != JOB_DONE) {
+      pthread_mutex_lock(&d->lock);
+      while (j->state != JOB_DONE) pthread_cond_wait(&d->done, &d->lock);
+      pthread_mutex_unlock(&d->lock);
+    }
+    if (j->err) {
+      fprintf(stderr, "[%s] error: corrupt %s input.\n", __func__, d->fmt == PDEC_BGZF ? "BGZF" : "zstd");
+      exit(1);
+    }
+    k = j->out_l - d->pos < len - n ? j->out_l - d->pos : len - n;
+    memcpy((char *) buf + n, j->out + d->pos, k);
+    d->pos += k;
+    n += k;
+    if (d->pos == j->out_l) {
+      /* keep its pieces, since the caller may not have used all its bytes yet */
+      if (d->fmt == PDEC_BGZF) {
+	unsigned char *in = d->prev.in;
+	size_t in_m = d->prev.in_m;
+	d->prev = *j;
+	j->in = in;
+	j->in_m = in_m;
+      }
+      d->d_off += j->out_l;
+      pthread_mutex_lock(&d->lock);
+      j->state = JOB_FREE;
+      d->taken++;
+      pthread_mutex_unlock(&d->lock);
+      d->pos = 0;
+    }
+  }
+  return n;
+}
+
+/* the virtual offset of decoded offset off, if it lies in job j, which starts at decoded offset base */
+static int job_tell(const pdec_job_t *j, uint64_t base, uint64_t off, uint64_t *voff) {
+  size_t o, bsize, isize;
+  for (o = 0; o < j->in_l; o += bsize, base += isize) {
+    bsize = block_size(j->in + o, j->in_l - o);
+    isize = le32(j->in + o + bsize - 4);
+    if (off < base + isize) {
+      *voff = (j->c_off + o) << 16 | (off - base);
+      return 0;
+    }
+  }
+  return -1;
+}
+
+/*
+   The BGZF virtual offset of decoded offset off: the compressed
+   offset of the block holding it (from where decoding started),
+   shifted left 16 bits, plus off's place in the block's decoded bytes.
+   Only the current and the previous job are at hand, which covers
+   whatever the caller has read but not used yet. Returns -1 if off is
+   not among them, or the input is not BGZF.
+*/
+int pdec_tell(const pdec_t *d, uint64_t off, uint64_t *voff) {
+  if (d->fmt != PDEC_BGZF) return -1;
+  if (off == d->d_off) { /* the start of the current job, which may not be decoded yet */
+    *voff = (d->taken < d->filled ? d->jobs[d->taken % d->n_jobs].c_off : d->c_in) << 16;
+    return 0;
+  }
+  if (off > d->d_off)
+    return d->pos ? job_tell(&d->jobs[d->taken % d->n_jobs], d->d_off, off, voff) : -1;
+  if (off >= d->d_off - d->prev.out_l)
+    return job_tell(&d->prev, d->d_off - d->prev.out_l, off, voff);
+  return -1;
+}
+
+void pdec_close(pdec_t *d) {
+  unsigned i;
+  if (!d) return;
+  pthread_mutex_lock(&d->lock);
+  d->stop = 1;
+  pthread_cond_broadcast(&d->work);
+  pthread_mutex_unlock(&d->lock);
+  for (i = 0; i < d->n_threads; i++) pthread_join(d->workers[i], NULL);
+  for (i = 0; i < d->n_jobs; i++) {
+    free(d->jobs[i].in);
+    free(d->jobs[i].out);
+  }
+  free(d->prev.in);
+  free(d->jobs);
+  free(d->workers);
+  pthread_mutex_destroy(&d->lock);
+  pthread_cond_destroy(&d->work);
+  pthread_cond_destroy(&d->done);
+  free(d);
+}
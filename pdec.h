@@ -0,0 +1,59 @@
+#ifndef PDEC_H
+#define PDEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/*
+   Parallel decoding of input made of independently compressed pieces:
+   BGZF blocks (as in BAM and bgzip) and zstd frames (as from pzstd or
+   the seekable format). Each piece records, or lets us walk to, its
+   own end, so pieces can be cut out of the input without decoding
+   them. The reader groups consecutive pieces into jobs, and worker
+   threads decode the jobs in parallel; the caller copies their output
+   in input order.
+*/
+
+#define PDEC_BGZF 0
+#define PDEC_ZSTD 1
+
+#define BGZF_MAX_BLOCK 65536
+#define PDEC_JOB_SIZE (1<<20) /* compressed bytes per job, at least */
+
+typedef struct {
+  unsigned char *in, *out;
+  size_t in_l, in_m, out_l, out_m;
+  uint64_t c_off; /* compressed offset of the first piece */
+  int state, err;
+} pdec_job_t;
+
+/* reads the next chunk of compressed input, as uio_next() */
+typedef size_t (*pdec_next_f)(void *src, const char **p);
+
+typedef struct {
+  int fmt;
+  pdec_next_f next;
+  void *src;
+  const unsigned char *p; /* compressed input not yet cut into pieces */
+  size_t n;
+  int eof, stop;
+  unsigned n_jobs, n_threads;
+  pdec_job_t *jobs;
+  uint64_t filled, taken; /* jobs queued, and jobs copied out */
+  size_t pos; /* bytes of the current job already copied out */
+  uint64_t c_in, d_off; /* compressed bytes cut so far; decoded offset of the current job */
+  pdec_job_t prev; /* pieces of the job copied out before the current one, for pdec_tell() */
+  pthread_t *workers;
+  pthread_mutex_t lock;
+  pthread_cond_t work, done;
+} pdec_t;
+
+int pdec_bgzf_check(const unsigned char *p, size_t n);
+int pdec_zstd_check(const unsigned char *p, size_t n);
+pdec_t *pdec_open(int fmt, pdec_next_f next, void *src, const unsigned char *p, size_t n, int n_threads);
+int pdec_read(pdec_t *d, void *buf, unsigned len);
+int pdec_tell(const pdec_t *d, uint64_t off, uint64_t *voff);
+void pdec_close(pdec_t *d);
+
+#endif
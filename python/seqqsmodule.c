@@ -0,0 +1,384 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <pythread.h>
+#include <stdint.h>
+#include "seqqs.h"
+
+/*
+   Python bindings over a qs_set_t. Stats.update() takes a batch of
+   reads as bytes-like objects and runs the C update with the GIL
+   released, so threads feeding separate Stats objects run in
+   parallel. Stats.ntm, Stats.qm and Stats.lm export the count matrices
+   themselves through the buffer protocol: numpy.asarray(stats.ntm) is
+   a read-only view, not a copy, whose counts change in place as reads
+   are added. Its rows are those seen when the view was taken.
+
+   A matrix block moves only when the set grows past its capacity, so
+   while any view is alive, an update that would grow it raises
+   BufferError instead; pass max_len to reserve the rows up front.
+   Each set has a lock, taken without the GIL, that serializes updates
+   and guards the export count. Reinitializing a Stats while another
+   thread is updating it raises RuntimeError.
+*/
+
+typedef struct {
+  PyObject_HEAD
+  qs_set_t *qs;
+  PyThread_type_lock lock;
+  Py_ssize_t n_exports;
+  int n_updates; /* updates running without the GIL; changed only with it */
+} StatsObject;
+
+typedef struct {
+  PyObject_HEAD
+  StatsObject *stats;
+  qs_matrix_t which;
+} MatrixObject;
+
+static PyTypeObject MatrixType;
+
+static void stats_lock(StatsObject *self) {
+  if (!PyThread_acquire_lock(self->lock, NOWAIT_LOCK)) {
+    Py_BEGIN_ALLOW_THREADS
+    PyThread_acquire_lock(self->lock, WAIT_LOCK);
+    Py_END_ALLOW_THREADS
+  }
+}
+
+static int parse_qual(const char *name, qual_type *qt) {
+  static const char *names[] = {"phred", "sanger", "solexa", "illumina"};
+  static const qual_type types[] = {PHRED, SANGER, SOLEXA, ILLUMINA};
+  int i;
+  if (!name) {
+    *qt = NONE;
+    return 0;
+  }
+  for (i = 0; i < 4; i++) {
+    if (!strcmp(name, names[i])) {
+      *qt = types[i];
+      return 0;
+    }
+  }
+  PyErr_Format(PyExc_ValueError, "unknown quality type '%s'", name);
+  return -1;
+}
+
+static int Stats_init(StatsObject *self, PyObject *args, PyObject *kwds) {
+  static char *kwlist[] = {"qual", "max_len", NULL};
+  const char *qual = "sanger";
+  Py_ssize_t max_len = 0;
+  qual_type qt;
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|zn", kwlist, &qual, &max_len))
+    return -1;
+  if (max_len < 0) {
+    PyErr_SetString(PyExc_ValueError, "max_len must not be negative");
+    return -1;
+  }
+  if (parse_qual(qual, &qt)) return -1;
+  if (self->n_updates) {
+    PyErr_SetString(PyExc_RuntimeError, "cannot reinitialize Stats while it is being updated");
+    return -1;
+  }
+  if (!self->lock && !(self->lock = PyThread_allocate_lock())) {
+    PyErr_NoMemory();
+    return -1;
+  }
+  stats_lock(self);
+  if (self->n_exports) {
+    PyThread_release_lock(self->lock);
+    PyErr_SetString(PyExc_BufferError, "cannot reinitialize Stats while matrices are exported");
+    return -1;
+  }
+  if (self->qs) qs_destroy(self->qs);
+  self->qs = qs_init(qt, 0, 0);
+  if (max_len) qs_reserve(self->qs, max_len);
+  PyThread_release_lock(self->lock);
+  return 0;
+}
+
+static void Stats_dealloc(StatsObject *self) {
+  if (self->qs) qs_destroy(self->qs);
+  if (self->lock) PyThread_free_lock(self->lock);
+  Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+/* borrow the buffers of a batch; on error, those already taken are released */
+static int get_buffers(PyObject *seq, Py_ssize_t n, Py_buffer *views, const char *what) {
+  Py_ssize_t i;
+  for (i = 0; i < n; i++) {
+    if (PyObject_GetBuffer(PySequence_Fast_GET_ITEM(seq, i), &views[i], PyBUF_SIMPLE)) {
+      PyErr_Format(PyExc_TypeError, "%s[%zd] is not a bytes-like object", what, i);
+      while (i--) PyBuffer_Release(&views[i]);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+PyDoc_STRVAR(Stats_update_doc,
+"update(seqs, quals=None)\n\n\
+Add a batch of reads. seqs is a sequence of bytes-like objects, one\n\
+per read; quals, if given, holds their quality strings in the same\n\
+order. The batch is counted with the GIL released.");
+
+static PyObject *Stats_update(StatsObject *self, PyObject *args, PyObject *kwds) {
+  static char *kwlist[] = {"seqs", "quals", NULL};
+  PyObject *seqs_in, *quals_in = Py_None, *seqs = NULL, *quals = NULL, *ret = NULL;
+  Py_buffer *views = NULL;
+  const char **s = NULL;
+  size_t *l = NULL, max_len = 0;
+  Py_ssize_t i, n, nv = 0;
+  int grows = 0;
+
+  if (!self->qs) {
+    PyErr_SetString(PyExc_ValueError, "Stats is not initialized");
+    return NULL;
+  }
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|O", kwlist, &seqs_in, &quals_in))
+    return NULL;
+  if (!(seqs = PySequence_Fast(seqs_in, "seqs must be a sequence")))
+    return NULL;
+  n = PySequence_Fast_GET_SIZE(seqs);
+  if (quals_in != Py_None) {
+    if (!(quals = PySequence_Fast(quals_in, "quals must be a sequence")))
+      goto out;
+    if (PySequence_Fast_GET_SIZE(quals) != n) {
+      PyErr_SetString(PyExc_ValueError, "seqs and quals differ in length");
+      goto out;
+    }
+  }
+
+  /* sequences, then qualities, in views[0..n) and views[n..2n) */
+  views = PyMem_Malloc((quals ? 2 : 1)*n*sizeof(Py_buffer) + 1);
+  s = PyMem_Malloc((quals ? 2 : 1)*n*sizeof(char *) + 1);
+  l = PyMem_Malloc((quals ? 2 : 1)*n*sizeof(size_t) + 1);
+  if (!views || !s || !l) {
+    PyErr_NoMemory();
+    goto out;
+  }
+  if (get_buffers(seqs, n, views, "seqs")) goto out;
+  nv = n;
+  if (quals) {
+    if (get_buffers(quals, n, views + n, "quals")) goto out;
+    nv = 2*n;
+  }
+  for (i = 0; i < nv; i++) {
+    s[i] = views[i].buf;
+    l[i] = views[i].len;
+    if (i < n && l[i] > max_len) max_len = l[i];
+  }
+
+  self->n_updates++;
+  Py_BEGIN_ALLOW_THREADS
+  PyThread_acquire_lock(self->lock, WAIT_LOCK);
+  grows = self->n_exports && max_len > qs_capacity(self->qs);
+  if (!grows)
+    qs_update_reads(self->qs, n, s, l, quals ? s + n : NULL, quals ? l + n : NULL, 0);
+  PyThread_release_lock(self->lock);
+  Py_END_ALLOW_THREADS
+  self->n_updates--;
+
+  if (grows) {
+    PyErr_Format(PyExc_BufferError, "a read of length %zu would move the exported matrices; "
+		 "release the views or pass a larger max_len", max_len);
+    goto out;
+  }
+  ret = Py_None;
+  Py_INCREF(ret);
+
+ out:
+  for (i = 0; i < nv; i++) PyBuffer_Release(&views[i]);
+  PyMem_Free(views);
+  PyMem_Free(s);
+  PyMem_Free(l);
+  Py_XDECREF(seqs);
+  Py_XDECREF(quals);
+  return ret;
+}
+
+PyDoc_STRVAR(Stats_summary_doc,
+"summary()\n\n\
+Run totals, such as reads and bases, as a dict.");
+
+static PyObject *Stats_summary(StatsObject *self, PyObject *unused) {
+  const char *names[QS_SUMMARY_MAX];
+  uint64_t vals[QS_SUMMARY_MAX];
+  PyObject *d, *v;
+  unsigned i, n;
+
+  if (!self->qs) {
+    PyErr_SetString(PyExc_ValueError, "Stats is not initialized");
+    return NULL;
+  }
+  stats_lock(self);
+  n = qs_summary(self->qs, names, vals);
+  PyThread_release_lock(self->lock);
+  if (!(d = PyDict_New())) return NULL;
+  for (i = 0; i < n; i++) {
+    if (!(v = PyLong_FromUnsignedLongLong(vals[i])) || PyDict_SetItemString(d, names[i], v)) {
+      Py_XDECREF(v);
+      Py_DECREF(d);
+      return NULL;
+    }
+    Py_DECREF(v);
+  }
+  return d;
+}
+
+static PyObject *Stats_matrix(StatsObject *self, void *closure) {
+  MatrixObject *m;
+  PyObject *view;
+  if (!self->qs) {
+    PyErr_SetString(PyExc_ValueError, "Stats is not initialized");
+    return NULL;
+  }
+  if ((qs_matrix_t) (intptr_t) closure == QS_QM && !qs_matrix(self->qs, QS_QM, &(size_t){0}, &(size_t){0}))
+    Py_RETURN_NONE;
+  if (!(m = PyObject_New(MatrixObject, &MatrixType))) return NULL;
+  Py_INCREF(self);
+  m->stats = self;
+  m->which = (qs_matrix_t) (intptr_t) closure;
+  view = PyMemoryView_FromObject((PyObject *) m);
+  Py_DECREF(m);
+  return view;
+}
+
+static PyObject *Stats_qual_min(StatsObject *self, void *closure) {
+  if (!self->qs) {
+    PyErr_SetString(PyExc_ValueError, "Stats is not initialized");
+    return NULL;
+  }
+  return PyLong_FromLong(qs_qual_min(self->qs));
+}
+
+static PyMethodDef Stats_methods[] = {
+  {"update", (PyCFunction) (void (*)(void)) Stats_update, METH_VARARGS | METH_KEYWORDS, Stats_update_doc},
+  {"summary", (PyCFunction) Stats_summary, METH_NOARGS, Stats_summary_doc},
+  {NULL}
+};
+
+static PyGetSetDef Stats_getset[] = {
+  {"ntm", (getter) Stats_matrix, NULL,
+   "Nucleotide counts by position, a read-only (positions, 17) view; columns follow NT_COLUMNS.",
+   (void *) (intptr_t) QS_NTM},
+  {"qm", (getter) Stats_matrix, NULL,
+   "Quality counts by position, a read-only (positions, qualities) view from qual_min up, or None without qualities.",
+   (void *) (intptr_t) QS_QM},
+  {"lm", (getter) Stats_matrix, NULL,
+   "Read counts by length, a read-only view; entry i counts reads of length i + 1.",
+   (void *) (intptr_t) QS_LM},
+  {"qual_min", (getter) Stats_qual_min, NULL, "Quality of the first qm column.", NULL},
+  {NULL}
+};
+
+PyDoc_STRVAR(Stats_doc,
+"Stats(qual='sanger', max_len=0)\n\n\
+Per-position nucleotide and quality statistics. qual is one of\n\
+'sanger', 'illumina', 'solexa' or 'phred', or None for FASTA.\n\
+max_len reserves rows for reads up to that length, so updates never\n\
+have to move the matrices while they are being viewed.");
+
+static PyTypeObject StatsType = {
+  PyVarObject_HEAD_INIT(NULL, 0)
+  .tp_name = "seqqs.Stats",
+  .tp_doc = Stats_doc,
+  .tp_basicsize = sizeof(StatsObject),
+  .tp_flags = Py_TPFLAGS_DEFAULT,
+  .tp_new = PyType_GenericNew,
+  .tp_init = (initproc) Stats_init,
+  .tp_dealloc = (destructor) Stats_dealloc,
+  .tp_methods = Stats_methods,
+  .tp_getset = Stats_getset,
+};
+
+/* shape and strides live after the format string, until release */
+typedef struct {
+  Py_ssize_t shape[2], strides[2];
+} matrix_dims_t;
+
+static int Matrix_getbuffer(MatrixObject *self, Py_buffer *view, int flags) {
+  StatsObject *st = self->stats;
+  matrix_dims_t *d;
+  const uint64_t *p;
+  size_t nrow, ncol;
+
+  if (flags & PyBUF_WRITABLE) {
+    PyErr_SetString(PyExc_BufferError, "seqqs matrices are read-only");
+    return -1;
+  }
+  if (!(d = PyMem_Malloc(sizeof(matrix_dims_t)))) {
+    PyErr_NoMemory();
+    return -1;
+  }
+  stats_lock(st);
+  p = qs_matrix(st->qs, self->which, &nrow, &ncol);
+  st->n_exports++;
+  PyThread_release_lock(st->lock);
+
+  d->shape[0] = nrow;
+  d->shape[1] = ncol;
+  d->strides[0] = ncol*sizeof(uint64_t);
+  d->strides[1] = sizeof(uint64_t);
+  view->buf = (void *) p;
+  view->obj = (PyObject *) self;
+  Py_INCREF(self);
+  view->len = nrow*ncol*sizeof(uint64_t);
+  view->itemsize = sizeof(uint64_t);
+  view->readonly = 1;
+  view->ndim = self->which == QS_LM ? 1 : 2;
+  view->format = (flags & PyBUF_FORMAT) ? "Q" : NULL;
+  view->shape = (flags & PyBUF_ND) ? d->shape : NULL;
+  view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? (view->ndim == 1 ? d->strides + 1 : d->strides) : NULL;
+  view->suboffsets = NULL;
+  view->internal = d;
+  return 0;
+}
+
+static void Matrix_releasebuffer(MatrixObject *self, Py_buffer *view) {
+  StatsObject *st = self->stats;
+  PyMem_Free(view->internal);
+  stats_lock(st);
+  st->n_exports--;
+  PyThread_release_lock(st->lock);
+}
+
+static void Matrix_dealloc(MatrixObject *self) {
+  Py_DECREF(self->stats);
+  PyObject_Del(self);
+}
+
+static PyBufferProcs Matrix_as_buffer = {
+  (getbufferproc) Matrix_getbuffer,
+  (releasebufferproc) Matrix_releasebuffer
+};
+
+static PyTypeObject MatrixType = {
+  PyVarObject_HEAD_INIT(NULL, 0)
+  .tp_name = "seqqs._Matrix",
+  .tp_basicsize = sizeof(MatrixObject),
+  .tp_flags = Py_TPFLAGS_DEFAULT,
+  .tp_dealloc = (destructor) Matrix_dealloc,
+  .tp_as_buffer = &Matrix_as_buffer,
+};
+
+static struct PyModuleDef seqqs_module = {
+  PyModuleDef_HEAD_INIT,
+  .m_name = "seqqs",
+  .m_doc = "Sequence quality statistics, counted natively.",
+  .m_size = -1,
+};
+
+PyMODINIT_FUNC PyInit_seqqs(void) {
+  PyObject *m;
+  if (PyType_Ready(&StatsType) < 0 || PyType_Ready(&MatrixType) < 0) return NULL;
+  if (!(m = PyModule_Create(&seqqs_module))) return NULL;
+  Py_INCREF(&StatsType);
+  if (PyModule_AddObject(m, "Stats", (PyObject *) &StatsType) ||
+      PyModule_AddStringConstant(m, "NT_COLUMNS", seq_nt17_rev_table)) {
+    Py_DECREF(&StatsType);
+    Py_DECREF(m);
+    return NULL;
+  }
+  return m;
+}
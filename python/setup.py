@@ -0,0 +1,21 @@
+import os
+from setuptools import setup, Extension
+
+# the library sources one directory up, built without main()
+top = os.path.relpath(os.path.join(os.path.dirname(os.path.abspath(__file__)), '..'))
+lib = ['seqqs.c', 'arena.c', 'sketch.c', 'spill.c', 'spectrum.c', 'emit.c',
+       'uio.c', 'pdec.c', 'names.c', 'live.c', 'demux.c', 'insert.c',
+       'complexity.c']
+
+setup(
+    name='seqqs',
+    version='0.01',
+    description='Sequence quality statistics, counted natively',
+    ext_modules=[Extension(
+        'seqqs',
+        sources=[os.path.join(os.path.dirname(__file__) or '.', 'seqqsmodule.c')] +
+                [os.path.join(top, f) for f in lib],
+        include_dirs=[top],
+        define_macros=[('_LIB_ONLY', None), ('VERSION', '0.01')],
+        extra_compile_args=['-std=gnu99', '-O3'],
+        libraries=['z', 'm', 'pthread'])])
@@ -1,5 +1,6 @@
 #include <assert.h>
 #include <ctype.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -7,6 +8,10 @@
 #include <limits.h>
 #include <math.h>
 #include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
 #include <zlib.h>
 
 #ifdef USE_SAMTOOLS_LIBS
@@ -16,6 +21,19 @@
 #include "khash.h"
 #include "kseq.h"
 #endif
+#include "seqqs.h"
+#include "arena.h"
+#include "sketch.h"
+#include "spill.h"
+#include "spectrum.h"
+#include "emit.h"
+#include "uio.h"
+#include "names.h"
+#include "live.h"
+#include "demux.h"
+#include "insert.h"
+#include "complexity.h"
+#include "bam.h"
 
 #ifndef _LIB_ONLY
 #define _SEQQS_MAIN
@@ -28,22 +46,25 @@
   }
 #endif
 
-KSEQ_INIT(gzFile, gzread)
+#ifdef _SEQQS_MAIN
+KSEQ_INIT(uio_in_t*, uio_read)
+#else
+/* the library only borrows kseq_t, and never reads a file itself */
+KSEQ_INIT2(static inline, uio_in_t*, uio_read)
+#endif
 KHASH_MAP_INIT_STR(str, uint64_t)
 
+#ifndef VERSION
+#define VERSION 0.01
+#endif
+#define XSTR(x) #x
+#define STR(x) XSTR(x)
+
 #define INIT_SEQLEN 10
 #ifndef kroundup32
 #define kroundup32(x) (--(x), (x)|=(x)>>1, (x)|=(x)>>2, (x)|=(x)>>4, (x)|=(x)>>8, (x)|=(x)>>16, ++(x))
 #endif
 
-typedef enum {
-  PHRED,
-  SANGER,
-  SOLEXA,
-  ILLUMINA,
-  NONE
-} qual_type;
-
 #define Q_OFFSET 0
 #define Q_MIN 1
 #define Q_MAX 2
@@ -86,16 +107,71 @@ unsigned char seq_nt17_table[256] = {
 
 char *seq_nt17_rev_table = "XACMGRSVTWYHKDBN-";
 
-typedef struct _qs_set_t {
+struct _qs_set_t {
   size_t l, m;
   unsigned k;
   uint64_t **ntm;
   uint64_t **qm;
   uint64_t *lm;
   qual_type qt;
+  int binned; /* rows are position bins (long-read mode), not positions */
   uint64_t n_uniq_kmer_pos;
+  uint64_t n_reads; /* records seen, sampled or not */
+  uint64_t n_sampled; /* records accumulated into the matrices */
+  uint64_t n_bases;
+  double converge_tol; /* convergence mode, if > 0 */
+  uint64_t converge_every, converged_at;
+  double *snap; /* normalized distributions at the last checkpoint */
+  size_t snap_l;
+  int64_t *tl; /* per-row totals at the last timeline window */
+  size_t tl_l;
   khash_t(str) *h;
-} qs_set_t;
+  char *kbuf; /* key being looked up in h: k-mer, '-', position */
+  qs_sketch_t *sk; /* approximate k-mer counts, replacing h */
+  spill_t *sp; /* sorted runs of h spilled to disk */
+  size_t spill_mem; /* spill h once it takes more than this */
+  arena_t *ka; /* keys of h, dropped at each spill */
+  spectrum_t *spec; /* whole-read k-mer spectrum, shared and not owned */
+  qs_sketch_t *over; /* read prefixes, for overrepresented sequences */
+  double over_frac; /* report prefixes above this fraction of reads */
+  complexity_t *cx; /* homopolymer tails and DUST scores */
+};
+
+/* 
+   Position bins for long reads, so memory no longer scales with the
+   longest read. The first BIN_EXACT positions get their own row; past
+   that, each power-of-two octave of positions is split into BIN_SUB
+   equal-width bins, so bin widths grow geometrically and even a 2^32
+   base read needs fewer than 500 rows. Read lengths use the same bins.
+*/
+#define BIN_EXACT_BITS 6
+#define BIN_SUB_BITS 4
+#define BIN_EXACT (1U << BIN_EXACT_BITS)
+#define BIN_SUB (1U << BIN_SUB_BITS)
+
+static inline unsigned pos_bin(uint64_t i) {
+  unsigned j;
+  if (i < BIN_EXACT) return (unsigned) i;
+  j = 63 - __builtin_clzll(i);
+  return BIN_EXACT + (j - BIN_EXACT_BITS)*BIN_SUB + (unsigned) ((i >> (j - BIN_SUB_BITS)) & (BIN_SUB - 1));
+}
+
+/* first (0-indexed) position in bin b */
+static inline uint64_t bin_start(unsigned b) {
+  unsigned j;
+  if (b < BIN_EXACT) return b;
+  j = BIN_EXACT_BITS + (b - BIN_EXACT)/BIN_SUB;
+  return (uint64_t) (BIN_SUB + (b - BIN_EXACT)%BIN_SUB) << (j - BIN_SUB_BITS);
+}
+
+/* matrix row for (0-indexed) position i */
+#define qs_row(qs, i) ((qs)->binned ? pos_bin(i) : (unsigned) (i))
+
+/* options for the statistics writers */
+typedef struct {
+  unsigned kmer_top; /* entries in the k-mer enrichment report */
+  int kmer_dump; /* also write every positional k-mer */
+} qs_outopt_t;
 
 static void qs_printstr(const kstring_t *s, unsigned line_len) {
   if (line_len != UINT_MAX) {
@@ -126,121 +202,414 @@ void qs_printseq(const kseq_t *s, int line_len) {
 }
 
 
-qs_set_t *qs_init(qual_type qt, unsigned k) {
+/* 
+   Grow a matrix to `to` rows, zeroing rows [from, to). Each matrix is
+   one row-major block starting at m[0], so it can be handed out whole
+   (see qs_matrix()); m[i] points at row i within it.
+*/
+static void qs_alloc_rows(uint64_t **m, size_t from, size_t to, unsigned ncol) {
+  size_t i;
+  uint64_t *block = realloc(from ? m[0] : NULL, to*ncol*sizeof(uint64_t));
+  if (!block) {
+    fprintf(stderr, "[%s] error: out of memory growing a matrix to %zu rows.\n", __func__, to);
+    exit(1);
+  }
+  memset(block + from*ncol, 0, (to - from)*ncol*sizeof(uint64_t));
+  for (i = 0; i < to; i++)
+    m[i] = block + i*ncol;
+}
+
+qs_set_t *qs_init(qual_type qt, unsigned k, int binned) {
   /* 
      Allocate matrices for quality and nucleotides. Rows correspond to
      position in sequence, so growing them is simpler.
   */
-  unsigned i;
   qs_set_t *qs = malloc(sizeof(qs_set_t));
   qs->qt = qt;
+  qs->binned = binned;
   qs->m = (size_t) INIT_SEQLEN;
 
   if (has_qual(qs)) {
     qs->qm = malloc(qs->m*sizeof(uint64_t*));
-    for (i = 0; i < qs->m; i++) 
-      qs->qm[i] = calloc(qrng(qs->qt), sizeof(uint64_t));
+    qs_alloc_rows(qs->qm, 0, qs->m, qrng(qs->qt));
   } else {
     qs->qm = NULL;
   }
 
   qs->l = 0;
   qs->n_uniq_kmer_pos = 0;
+  qs->n_reads = qs->n_sampled = qs->n_bases = 0;
+  qs->converge_tol = 0;
+  qs->converge_every = qs->converged_at = 0;
+  qs->snap = NULL;
+  qs->snap_l = 0;
+  qs->tl = NULL;
+  qs->tl_l = 0;
   qs->k = k;
   qs->h = k > 0 ? kh_init(str) : NULL;
+  qs->kbuf = k > 0 ? malloc(k + 12) : NULL;
+  qs->sk = NULL;
+  qs->sp = NULL;
+  qs->spill_mem = 0;
+  qs->ka = arena_init(0);
+  qs->spec = NULL;
+  qs->over = NULL;
+  qs->over_frac = 0;
+  qs->cx = NULL;
   qs->ntm = malloc(qs->m*sizeof(uint64_t*));
-
-  for (i = 0; i < qs->m; i++)
-    qs->ntm[i] = calloc(17, sizeof(uint64_t));
+  qs_alloc_rows(qs->ntm, 0, qs->m, 17);
 
   qs->lm = calloc(qs->m, sizeof(uint64_t));
   return qs;
 }
 
-void qs_update(qs_set_t *qs, kseq_t *seq, int strict) {
-  unsigned i, last_m, nt, non_iupac=0;
-  char bq;
-  if (seq->seq.l > qs->m) {
+/* 
+   Count positional k-mers approximately, in mem bytes, rather than
+   exactly in a hash.
+*/
+void qs_use_sketch(qs_set_t *qs, size_t mem) {
+  if (!qs->k) return;
+  kh_destroy(str, qs->h);
+  qs->h = NULL;
+  qs->sk = sketch_init(qs->k, mem);
+}
+
+/* 
+   Count positional k-mers exactly, but spill the hash to sorted runs
+   on disk whenever it grows past mem bytes.
+*/
+void qs_use_spill(qs_set_t *qs, size_t mem) {
+  if (!qs->k) return;
+  qs->sp = spill_init(qs->k);
+  qs->spill_mem = mem;
+}
+
+/* 
+   Overrepresented sequences: the first OVER_LEN bases of each read go
+   into a Space-Saving table of OVER_CAP/frac entries, so memory is
+   fixed and no count is off by more than frac/OVER_CAP of the reads.
+   Every prefix above frac is then guaranteed to be reported.
+*/
+#define OVER_LEN 50
+#define OVER_CAP 10
+
+void qs_use_overrep(qs_set_t *qs, double frac) {
+  qs->over = sketch_ss_init(OVER_LEN, (size_t) ceil(OVER_CAP/frac));
+  qs->over_frac = frac;
+}
+
+/* trailing homopolymers and low-complexity scores of each read */
+void qs_use_complexity(qs_set_t *qs) {
+  qs->cx = complexity_init();
+}
+
+/* 
+   A loop of its own while the read is still in L1: folded into the
+   matrix loop, the rolling state is kept in memory rather than in
+   registers, which costs more than going over the read again.
+*/
+static inline void qs_complexity_add(qs_set_t *qs, const kseq_t *seq) {
+  const char *s = seq->seq.s;
+  size_t i, l = seq->seq.l;
+  cx_roll_t r;
+  complexity_start(&r);
+  for (i = 0; i < l; i++) complexity_base(&r, s[i]);
+  complexity_end(qs->cx, &r, qs_row(qs, l - r.run));
+}
+
+static inline void qs_over_add(qs_set_t *qs, const kseq_t *seq) {
+  char key[OVER_LEN];
+  unsigned l = seq->seq.l < OVER_LEN ? seq->seq.l : OVER_LEN;
+  /* shorter reads are told apart by their length, in the position field */
+  memcpy(key, seq->seq.s, l);
+  memset(key + l, 0, OVER_LEN - l);
+  sketch_ss_add(qs->over, key, l, 0);
+}
+
+static inline size_t qs_kmer_bytes(const qs_set_t *qs) {
+  return kh_n_buckets(qs->h)*(sizeof(char*) + sizeof(uint64_t) + 1) + qs->ka->reserved;
+}
+
+static unsigned sort_k;
+
+static int cmp_kmer_rec(const void *a, const void *b) {
+  const kmer_rec_t *x = a, *y = b;
+  return kmer_rec_cmp(x->kmer, x->pos, y->kmer, y->pos, sort_k);
+}
+
+/* the k-mer hash as records sorted by position, then k-mer */
+static kmer_rec_t *qs_kmer_sorted(qs_set_t *qs, size_t *n) {
+  khiter_t k;
+  size_t i = 0;
+  kmer_rec_t *recs = malloc((kh_size(qs->h) + 1) * sizeof(kmer_rec_t));
+  for (k = kh_begin(qs->h); k != kh_end(qs->h); ++k) {
+    if (!kh_exist(qs->h, k)) continue;
+    recs[i].kmer = kh_key(qs->h, k);
+    recs[i].pos = strtoul(recs[i].kmer + qs->k + 1, NULL, 10);
+    recs[i++].count = kh_value(qs->h, k);
+  }
+  sort_k = qs->k;
+  qsort(recs, i, sizeof(kmer_rec_t), cmp_kmer_rec);
+  *n = i;
+  return recs;
+}
+
+/* write the k-mer hash out as a sorted run and start it afresh */
+static void qs_spill(qs_set_t *qs) {
+  size_t n;
+  kmer_rec_t *recs;
+  if (!kh_size(qs->h)) return;
+  recs = qs_kmer_sorted(qs, &n);
+  spill_run(qs->sp, recs, n);
+  free(recs);
+  kh_destroy(str, qs->h);
+  qs->h = kh_init(str);
+  arena_destroy(qs->ka);
+  qs->ka = arena_init(0);
+}
+
+/* 
+   Iterates over exact positional k-mer counts, either from memory or by
+   merging the spilled runs. Merged runs always come out sorted; the
+   in-memory hash is only sorted if asked for, as that is costly.
+*/
+typedef struct {
+  kmer_rec_t *recs;
+  size_t i, n;
+  spill_merge_t *m;
+  khash_t(str) *h; /* walked in place when unsorted */
+  unsigned k;
+} kmer_iter_t;
+
+static void kmer_iter_init(kmer_iter_t *it, qs_set_t *qs, int sorted) {
+  memset(it, 0, sizeof(kmer_iter_t));
+  if (qs->sp && qs->sp->n_runs) {
+    qs_spill(qs);
+    it->m = spill_merge_init(qs->sp);
+  } else if (sorted) {
+    it->recs = qs_kmer_sorted(qs, &it->n);
+  } else {
+    it->h = qs->h;
+    it->i = kh_begin(qs->h);
+    it->k = qs->k;
+  }
+}
+
+static inline int kmer_iter_next(kmer_iter_t *it, kmer_rec_t *rec) {
+  if (it->m) return spill_merge_next(it->m, rec);
+  if (it->h) {
+    while (it->i != kh_end(it->h) && !kh_exist(it->h, it->i)) it->i++;
+    if (it->i == kh_end(it->h)) return 0;
+    rec->kmer = kh_key(it->h, it->i);
+    rec->pos = strtoul(rec->kmer + it->k + 1, NULL, 10);
+    rec->count = kh_value(it->h, it->i++);
+    return 1;
+  }
+  if (it->i == it->n) return 0;
+  *rec = it->recs[it->i++];
+  return 1;
+}
+
+static void kmer_iter_destroy(kmer_iter_t *it) {
+  spill_merge_destroy(it->m);
+  free(it->recs);
+}
+
+/* 
+   Stop accumulating once the distributions stabilize: every `every'
+   reads, each position's normalized nucleotide and quality
+   distributions are compared with the previous checkpoint, and once no
+   proportion moved by more than tol, later reads only update the read,
+   base, and length counts.
+*/
+void qs_use_converge(qs_set_t *qs, double tol, uint64_t every) {
+  qs->converge_tol = tol;
+  qs->converge_every = every;
+}
+
+static void qs_normalize(double *dst, uint64_t *row, unsigned ncol) {
+  unsigned j;
+  uint64_t sum = 0;
+  for (j = 0; j < ncol; j++) sum += row[j];
+  for (j = 0; j < ncol; j++) dst[j] = sum ? (double) row[j]/sum : 0;
+}
+
+static int qs_converged(qs_set_t *qs) {
+  unsigned i, nq = has_qual(qs) ? qrng(qs->qt) : 0, ncol = 17 + nq;
+  size_t n = qs->l*ncol;
+  double *snap = malloc(n*sizeof(double)), diff = 0;
+
+  for (i = 0; i < qs->l; i++) {
+    qs_normalize(snap + i*ncol, qs->ntm[i], 17);
+    if (nq) qs_normalize(snap + i*ncol + 17, qs->qm[i], nq);
+  }
+  /* new positions since the last checkpoint mean no convergence yet */
+  if (!qs->snap || qs->snap_l != qs->l) diff = INFINITY;
+  else
+    for (i = 0; i < n; i++)
+      diff = fmax(diff, fabs(snap[i] - qs->snap[i]));
+
+  free(qs->snap);
+  qs->snap = snap;
+  qs->snap_l = qs->l;
+  return diff < qs->converge_tol;
+}
+
+/* make room for nrow rows without counting them as seen */
+void qs_reserve(qs_set_t *qs, size_t nrow) {
+  size_t last_m;
+  if (nrow > qs->m) {
     /* grow all matrices */
     last_m = qs->m;
-    qs->m = seq->seq.l + 1;
+    qs->m = nrow + 1;
     kroundup32(qs->m);
     /* fprintf(stderr, "[%s] adding rows to matrix (old size: %d; new size: %d)\n", __func__, last_m, qs->m); */
     qs->ntm = realloc(qs->ntm, sizeof(uint64_t*)*qs->m);
     qs->lm = realloc(qs->lm, sizeof(uint64_t)*qs->m);
+    memset(qs->lm + last_m, 0, sizeof(uint64_t)*(qs->m - last_m));
 
-    for (i = last_m; i < qs->m; i++)
-      qs->ntm[i] = calloc(17, sizeof(uint64_t));
+    qs_alloc_rows(qs->ntm, last_m, qs->m, 17);
     
     if (has_qual(qs)) {
       qs->qm = realloc(qs->qm, sizeof(uint64_t*)*qs->m);
-      for (i = last_m; i < qs->m; i++)
-	qs->qm[i] = calloc(qrng(qs->qt), sizeof(uint64_t));
+      qs_alloc_rows(qs->qm, last_m, qs->m, qrng(qs->qt));
     }
   }
+}
+
+size_t qs_capacity(const qs_set_t *qs) {
+  return qs->m;
+}
+
+/* 
+   A matrix as one row-major block of nrow x ncol counts, covering the
+   rows seen so far. The block stays put until the set grows past
+   qs_capacity() rows.
+*/
+const uint64_t *qs_matrix(const qs_set_t *qs, qs_matrix_t which, size_t *nrow, size_t *ncol) {
+  *nrow = qs->l;
+  switch (which) {
+  case QS_NTM: *ncol = 17; return qs->ntm[0];
+  case QS_QM: *ncol = has_qual(qs) ? qrng(qs->qt) : 0; return has_qual(qs) ? qs->qm[0] : NULL;
+  case QS_LM: *ncol = 1; return qs->lm;
+  }
+  return NULL;
+}
+
+int qs_qual_min(const qs_set_t *qs) {
+  return has_qual(qs) ? qmin(qs->qt) : 0;
+}
+
+static void qs_grow(qs_set_t *qs, unsigned nrow) {
+  qs_reserve(qs, nrow);
 
   /* update largest sequence encountered */
-  if (seq->seq.l > qs->l) qs->l = seq->seq.l;
+  if (nrow > qs->l) qs->l = nrow;
+}
+
+/* count a read, its bases, and its length only */
+static void qs_count(qs_set_t *qs, const kseq_t *seq) {
+  unsigned nrow;
+  qs->n_reads++;
+  qs->n_bases += seq->seq.l;
+  if (!seq->seq.l) return;
+  nrow = qs_row(qs, seq->seq.l - 1) + 1;
+  qs_grow(qs, nrow);
+  qs->lm[nrow-1]++;
+}
+
+/* count one positional k-mer in the exact hash */
+static inline void qs_kmer_add(qs_set_t *qs, const char *s, unsigned pos) {
+  khiter_t key;
+  int ret, n = 0;
+  char *p = qs->kbuf + qs->k, digits[10];
+
+  memcpy(qs->kbuf, s, qs->k);
+  *p++ = '-';
+  do digits[n++] = '0' + pos%10; while (pos /= 10);
+  while (n) *p++ = digits[--n];
+  *p = '\0';
+
+  key = kh_get(str, qs->h, qs->kbuf);
+  if (key == kh_end(qs->h)) {
+    key = kh_put(str, qs->h, arena_strdup(qs->ka, qs->kbuf), &ret);
+    kh_value(qs->h, key) = 1;
+    qs->n_uniq_kmer_pos++;
+  } else {
+    kh_value(qs->h, key)++;
+  }
+}
+
+void qs_update(qs_set_t *qs, kseq_t *seq, int strict) {
+  unsigned i, r, nt, non_iupac=0, nrow;
+  uint64_t next;
+  char bq;
+  spec_roll_t roll = {0, 0, 0};
+
+  if (qs->converged_at) {
+    qs_count(qs, seq);
+    return;
+  }
+  qs->n_reads++;
+  qs->n_sampled++;
+  qs->n_bases += seq->seq.l;
+  if (!seq->seq.l) return;
+  nrow = qs_row(qs, seq->seq.l - 1) + 1;
+  qs_grow(qs, nrow);
+  if (qs->over) qs_over_add(qs, seq);
+  if (qs->cx) qs_complexity_add(qs, seq);
   
   /* update length (0-indexed) */
-  qs->lm[seq->seq.l-1]++;
+  qs->lm[nrow-1]++;
 
-  char *kmer=NULL;
-  khiter_t key;
-  int is_missing, ret;
-  if (qs->k) kmer = malloc(sizeof(char)*(qs->k + 2 + log10(UINT_MAX)));
+  if (qs->k > seq->seq.l)
+    fprintf(stderr, "[%s] warning: k-mer length longer than sequence '%s'\n", __func__, seq->name.s);
 
   if (seq->qual.l && seq->seq.l != seq->qual.l) {
     fprintf(stderr, "[%s] warning: quality and sequence lengths differ in sequence '%s'\n", __func__, seq->name.s);
     if (strict) exit(1);
   }
 
-  for (i = 0; i < seq->seq.l; i++) {
+  for (i = 0, r = 0, next = 1; i < seq->seq.l; i++) {
+    /* matrix row of this position */
+    if (!qs->binned) r = i;
+    else if (i == next) next = bin_start(++r + 1);
+
     /* update nucleotide composition */
-    nt = seq_nt17_table[(int) seq->seq.s[i]];
+    nt = seq_nt17_table[(unsigned char) seq->seq.s[i]];
     if (!nt) non_iupac++;
-    qs->ntm[i][nt]++;
+    qs->ntm[r][nt]++;
+    if (qs->spec) spectrum_base(qs->spec, &roll, seq->seq.s[i]);
     
     /* update quality composition */
     if (has_qual(qs)) {
-      if (seq->qual.l) {
+      if (i < seq->qual.l) {
 	bq = (char) seq->qual.s[i];
 	if (bq - qoffset(qs->qt) < qmin(qs->qt) || 
 	    bq - qoffset(qs->qt) > qmax(qs->qt)) {
 	  fprintf(stderr, "[%s] warning: base quality '%d' out of range (%d <= b <= %d) in sequence '%s'\n", __func__, bq, qmin(qs->qt), qmax(qs->qt), seq->name.s);
 	  if (strict) exit(1);
+	} else {
+	  qs->qm[r][bq - qoffset(qs->qt) - qmin(qs->qt)]++;
 	}
-	qs->qm[i][bq - qoffset(qs->qt) - qmin(qs->qt)]++;
       }
     }
 
     /* hash positional k-mers */
     if (qs->k) {
-      if (qs->k > seq->seq.l) {
-	fprintf(stderr, "[%s] warning: k-mer length longer than sequence '%s'\n", __func__, seq->name.s);
-      } else {
-	if (i <= seq->seq.l-qs->k) {
-	  strncpy(kmer, seq->seq.s, (size_t) qs->k);
-	  sprintf(kmer + qs->k, "-%u", i+1);
-	  
-	  /* hash kmer */
-	  key = kh_get(str, qs->h, kmer);
-	  is_missing = (key == kh_end(qs->h));
-	  if (is_missing) {
-	    key = kh_put(str, qs->h, strdup(kmer), &ret);
-	    kh_value(qs->h, key) = 1;
-	    qs->n_uniq_kmer_pos++;
-	  } else {
-	    kh_value(qs->h, key) = kh_value(qs->h, key) + 1;
-	  }
+      if (qs->k <= seq->seq.l) {
+	if (i <= seq->seq.l-qs->k && qs->sk) {
+	  sketch_add(qs->sk, seq->seq.s + i, qs->binned ? (uint32_t) bin_start(r) + 1 : i+1, r);
+	} else if (i <= seq->seq.l-qs->k) {
+	  qs_kmer_add(qs, seq->seq.s + i, qs->binned ? (unsigned) bin_start(r) + 1 : i+1);
 	}
       }
     }
   }
 
-  
-  if (qs->k) 
-    free(kmer);
+  if (qs->sp && qs_kmer_bytes(qs) > qs->spill_mem) qs_spill(qs);
+  if (qs->converge_tol > 0 && qs->n_sampled % qs->converge_every == 0 && qs_converged(qs))
+    qs->converged_at = qs->n_sampled;
   
   if (non_iupac) {
     fprintf(stderr, "[%s] warning: %d non-IUPAC characters found in sequence '%s'.\n", __func__, non_iupac, seq->name.s);
@@ -248,272 +617,2232 @@ void qs_update(qs_set_t *qs, kseq_t *seq, int strict) {
   }
 }
 
-void qs_qm_fprint(FILE *file, qs_set_t *qs) {
-  unsigned i, j;
-  uint64_t cnt;
-  char bq;
-  
-  if (!has_qual(qs)) return;
+/* count a record left out of the statistics by sampling */
+void qs_skip(qs_set_t *qs, const kseq_t *seq) {
+  qs->n_reads++;
+  qs->n_bases += seq->seq.l;
+}
 
-  for (j = 0; j < qrng(qs->qt); j++) {
-    bq = j + qoffset(qs->qt) + qmin(qs->qt);
-    fprintf(file, "Q%d", bq);
-    if (j < qrng(qs->qt)-1) fputc('\t', file);
-  }
-  fputc('\n', file);
+/* 
+   Specialized versions of qs_update(), one per combination of quality
+   type (or FASTA), k-mers on or off, and strictness, so the per-base
+   loop has no mode branches. Qualities are range-checked for the whole
+   read up front; a read that needs a warning (bad qualities, a length
+   mismatch, shorter than k) goes through qs_update() instead, so
+   behavior is unchanged. With fixed-length reads, the matrices never
+   need to grow after the first read, and the only per-read bookkeeping
+   left is a length comparison. Binned rows, sketches, spectra, and
+   convergence mode use qs_update().
+*/
+typedef void (*qs_update_f)(qs_set_t *qs, kseq_t *seq, int strict);
 
-  for (i = 0; i < qs->l; i++) {
-    for (j = 0; j < qrng(qs->qt); j++) {
-      cnt = qs->qm[i][j];
-      fprintf(file, "%llu", (long long unsigned int) cnt);
-      if (j < qrng(qs->qt)-1) fputc('\t', file);
-    }
-    fputc('\n', file);
+#define QS_KERNEL(fn, QT, KMER, STRICT)				\
+  static void fn(qs_set_t *qs, kseq_t *seq, int strict) {		\
+    const unsigned char *s = (const unsigned char *) seq->seq.s;	\
+    const unsigned char *q = (const unsigned char *) seq->qual.s;	\
+    unsigned i, l = seq->seq.l, non_iupac = 0, bad = 0;		\
+    if (!l || (QT != NONE && seq->qual.l != l) || (KMER && qs->k > l)) { \
+      qs_update(qs, seq, STRICT);					\
+      return;								\
+    }									\
+    if (QT != NONE) {							\
+      for (i = 0; i < l; i++)						\
+	bad |= (unsigned char) (q[i] - qoffset(QT) - qmin(QT)) >= qrng(QT); \
+      if (bad) {							\
+	qs_update(qs, seq, STRICT);					\
+	return;								\
+      }									\
+    }									\
+    qs->n_reads++;							\
+    qs->n_sampled++;							\
+    qs->n_bases += l;							\
+    if (l > qs->l) qs_grow(qs, l);					\
+    qs->lm[l-1]++;							\
+    if (qs->cx) qs_complexity_add(qs, seq);				\
+    for (i = 0; i < l; i++) {						\
+      unsigned nt = seq_nt17_table[s[i]];				\
+      non_iupac += !nt;							\
+      qs->ntm[i][nt]++;							\
+      if (QT != NONE) qs->qm[i][q[i] - qoffset(QT) - qmin(QT)]++;	\
+    }									\
+    if (KMER) {								\
+      for (i = 0; i + qs->k <= l; i++)					\
+	qs_kmer_add(qs, seq->seq.s + i, i+1);				\
+      if (qs->sp && qs_kmer_bytes(qs) > qs->spill_mem) qs_spill(qs);	\
+    }									\
+    if (non_iupac) {							\
+      fprintf(stderr, "[%s] warning: %d non-IUPAC characters found in sequence '%s'.\n", "qs_update", non_iupac, seq->name.s); \
+      if (STRICT) exit(1);						\
+    }									\
   }
-  fputc('\n', file);
-}
 
-void qs_ntm_fprint(FILE *file, qs_set_t *qs) {
-  unsigned i, j;
-  uint64_t cnt;
+#define QS_KERNELS(suffix, QT)			\
+  QS_KERNEL(qs_update_##suffix, QT, 0, 0)	\
+  QS_KERNEL(qs_update_##suffix##_s, QT, 0, 1)	\
+  QS_KERNEL(qs_update_##suffix##_k, QT, 1, 0)	\
+  QS_KERNEL(qs_update_##suffix##_ks, QT, 1, 1)
 
-  for (j = 0; j < 17; ++j) {
-    fputc(seq_nt17_rev_table[j], file);
-    if (j < 16) fputc('\t', file);
-  }
-  fputc('\n', file);
+QS_KERNELS(sanger, SANGER)
+QS_KERNELS(solexa, SOLEXA)
+QS_KERNELS(illumina, ILLUMINA)
+QS_KERNELS(fasta, NONE)
 
-  for (i = 0; i < qs->l; i++) {
-    for (j = 0; j < 17; j++) {
-      cnt = qs->ntm[i][j];
-      fprintf(file, "%llu", (long long unsigned int) cnt);
-      if (j < 16) fputc('\t', file);
-    }
-    fputc('\n', file);
+/* pick the update function for a set; done once per run */
+qs_update_f qs_update_kernel(const qs_set_t *qs, int strict) {
+  static const qs_update_f kernels[][4] = {
+    {qs_update_sanger, qs_update_sanger_s, qs_update_sanger_k, qs_update_sanger_ks},
+    {qs_update_solexa, qs_update_solexa_s, qs_update_solexa_k, qs_update_solexa_ks},
+    {qs_update_illumina, qs_update_illumina_s, qs_update_illumina_k, qs_update_illumina_ks},
+    {qs_update_fasta, qs_update_fasta_s, qs_update_fasta_k, qs_update_fasta_ks}
+  };
+  int t;
+  if (qs->binned || qs->sk || qs->spec || qs->over || qs->converge_tol > 0) return qs_update;
+  switch (qs->qt) {
+  case SANGER: t = 0; break;
+  case SOLEXA: t = 1; break;
+  case ILLUMINA: t = 2; break;
+  case NONE: t = 3; break;
+  default: return qs_update;
   }
-  fputc('\n', file);
+  return kernels[t][(qs->k > 0)*2 + (strict != 0)];
 }
 
-void qs_lm_fprint(FILE *file, qs_set_t *qs) {
-  unsigned i;
-  fprintf(file, "pos\tcount\n");
-  for (i = 0; i < qs->l; i++) {
-    fprintf(file, "%d\t%llu\n", i+1, (long long unsigned int) qs->lm[i]);
+/* 
+   Update from n reads held in plain buffers, which need not be
+   NUL-terminated; qual may be NULL, as may any qual[i]. The records
+   are only read.
+*/
+void qs_update_reads(qs_set_t *qs, size_t n, const char *const *seq, const size_t *len,
+		     const char *const *qual, const size_t *qlen, int strict) {
+  qs_update_f update = qs_update_kernel(qs, strict);
+  kseq_t r;
+  size_t i;
+  memset(&r, 0, sizeof(r));
+  r.name.s = "-";
+  r.name.l = 1;
+  for (i = 0; i < n; i++) {
+    r.seq.s = (char *) seq[i];
+    r.seq.l = len[i];
+    r.qual.s = qual && qual[i] ? (char *) qual[i] : NULL;
+    r.qual.l = qual && qual[i] ? qlen[i] : 0;
+    update(qs, &r, strict);
   }
-  fputc('\n', file);
 }
 
-void qs_kmer_fprint(FILE *file, qs_set_t *qs) {
-  if (!qs->k) return;
-  khiter_t k;
+/* 
+   Positional k-mer enrichment. The expected count of a k-mer at a
+   position is its count over all positions times the fraction of all
+   k-mers that start at that position. Only the top entries by
+   observed/expected ratio are kept, using a bounded min-heap.
+*/
+#define ENRICH_MIN_COUNT 5
+
+typedef struct {
   char *key;
-  int i = 0;
-  fprintf(file, "kmer\tpos\tcount\n");
-  for (k = kh_begin(qs->h); k != kh_end(qs->h); ++k) {
-    if (!kh_exist(qs->h, k)) continue;
-    key = (char*) kh_key(qs->h, k);
-    fprintf(file, "%.*s\t%s\t%llu\n", qs->k, key, key+(qs->k+1), (long long unsigned int) kh_value(qs->h, k));
-    i++;
-    free((char *) kh_key(qs->h, k));
+  unsigned pos;
+  uint64_t obs;
+  double exp, ratio;
+} qs_enrich_t;
+
+/* ties are broken on position and k-mer, so the report is deterministic */
+static unsigned enrich_k;
+
+static inline int enrich_lt(const qs_enrich_t *a, const qs_enrich_t *b) {
+  if (a->ratio != b->ratio) return a->ratio < b->ratio;
+  if (a->obs != b->obs) return a->obs < b->obs;
+  return kmer_rec_cmp(a->key, a->pos, b->key, b->pos, enrich_k) > 0;
+}
+
+static void enrich_siftdown(qs_enrich_t *heap, size_t n, size_t i) {
+  size_t c;
+  qs_enrich_t tmp;
+  while ((c = 2*i + 1) < n) {
+    if (c + 1 < n && enrich_lt(&heap[c+1], &heap[c])) c++;
+    if (!enrich_lt(&heap[c], &heap[i])) break;
+    tmp = heap[i]; heap[i] = heap[c]; heap[c] = tmp;
+    i = c;
   }
-  fputc('\n', file);
 }
 
+static void enrich_siftup(qs_enrich_t *heap, size_t i) {
+  size_t p;
+  qs_enrich_t tmp;
+  while (i > 0 && enrich_lt(&heap[i], &heap[p = (i-1)/2])) {
+    tmp = heap[i]; heap[i] = heap[p]; heap[p] = tmp;
+    i = p;
+  }
+}
 
-void qs_destroy(qs_set_t *qs) {
+/* 
+   The heap is allocated with room for top keys after the entries; each
+   slot's key buffer travels with its entry.
+*/
+static qs_enrich_t *enrich_alloc(unsigned top, unsigned k) {
   unsigned i;
-  for (i = 0; i < qs->m; i++)
-    free(qs->ntm[i]);
-  if (has_qual(qs)) {
-    for (i = 0; i < qs->m; i++)
-      free(qs->qm[i]);
-    free(qs->qm);
+  qs_enrich_t *heap = malloc(top * (sizeof(qs_enrich_t) + k));
+  char *keys = (char *) (heap + top);
+  for (i = 0; i < top; i++) heap[i].key = keys + (size_t) i*k;
+  return heap;
+}
+
+static inline void enrich_push(qs_enrich_t *heap, size_t *nh, unsigned top, qs_enrich_t *e) {
+  char *key;
+  if (*nh < top) {
+    key = heap[*nh].key;
+    memcpy(key, e->key, enrich_k);
+    e->key = key;
+    heap[*nh] = *e;
+    enrich_siftup(heap, (*nh)++);
+  } else if (enrich_lt(&heap[0], e)) {
+    key = heap[0].key;
+    memcpy(key, e->key, enrich_k);
+    e->key = key;
+    heap[0] = *e;
+    enrich_siftdown(heap, *nh, 0);
   }
-  kh_destroy(str, qs->h);
-  free(qs->ntm);
-  free(qs->lm);
-  free(qs);
 }
 
-int is_interleaved_pair(const char *s1, const char *s2) {
-  while (*s1 && *s2) {
-    /* strings should be identical apart from trailing 1 or 2
-       (i.e. seq-a/1 and seq-a/2) */
-    if (*s1 != *s2 && (*s1 != '1' && *s2 != '2'))
-      return 0;
-    s1++; s2++;
+/* heap sort in place; the min-heap leaves entries in decreasing order */
+static void enrich_sort(qs_enrich_t *heap, size_t nh) {
+  size_t i;
+  qs_enrich_t tmp;
+  for (i = nh; i > 1; i--) {
+    tmp = heap[0]; heap[0] = heap[i-1]; heap[i-1] = tmp;
+    enrich_siftdown(heap, i-1, 0);
   }
-  return 1;
 }
 
-#ifdef _SEQQS_MAIN
+/* 
+   With approximate counting, only the heavy hitters are candidates.
+   Observed counts are their guaranteed lower bounds, so rare k-mers
+   that happen to be tracked cannot look enriched, and k-mer totals
+   come from the k-mer sketch.
+*/
+static qs_enrich_t *sketch_enrich(qs_set_t *qs, unsigned top, size_t *n) {
+  qs_sketch_t *sk = qs->sk;
+  qs_enrich_t *heap, e;
+  size_t i, nh = 0;
 
-int usage() {
-  fputs("\
-Usage: seqqs [options] <in.fq>\n\n\
-Options: -q    quality type, either illumina, solexa, or sanger (default: sanger)\n\
-         -p    prefix for output files (default: none)\n\
-         -k    hash k-mers of length k (default: off)\n\
-         -e    emit reads to stdout, for pipelining (default: off)\n\
-         -f    input is FASTA (no quality lines, default: off)\n\
-         -i    input is interleaved, output statistics per each file (default: off)\n\
-         -s    strict; some warnings become errors (default: off)\n\
-Arguments:  <in.fq> or '-' for stdin.\n\n\
-Output:\n\
-<prefix> is output prefix name. The following output files will be created:\n\
-<prefix>_qual.txt:  quality distribution by position matrix\n\
-<prefix>_nucl.txt:  nucleotide distribution by position matrix\n\
-<prefix>_len.txt:   length distribution by position matrix\n\
-<prefix>_kmer.txt:  k-mer distribution by position matrix\n\
-\
-If -i is used, these will have \"_1.txt\" and \"_2.txt\" suffixes.\n", stderr);
-  return 1;
+  if (top > sk->n) top = sk->n;
+  heap = enrich_alloc(top, sk->k);
+  for (i = 0; i < sk->n; i++) {
+    e.key = sk->keys + i*sk->k;
+    e.pos = sk->e[i].pos;
+    e.obs = sk->e[i].count - sk->e[i].err;
+    if (e.obs < ENRICH_MIN_COUNT) continue;
+    e.exp = (double) sketch_query_kmer(sk, e.key) * sk->row_total[sk->e[i].row] / sk->total;
+    e.ratio = e.obs / e.exp;
+    enrich_push(heap, &nh, top, &e);
+  }
+  enrich_sort(heap, nh);
+  *n = nh;
+  return heap;
 }
 
-int main(int argc, char *argv[]) {
-  int c, pr=0, k=0, emit=0, strict=0, interleaved=0;
-  int has_prefix=0;
-  char *qual_fn="qual.txt", *nucl_fn="nucl.txt", *len_fn="len.txt", *kmer_fn="kmer.txt";
-  char *prefix="", *rname;
-  FILE *qual_fp[2], *nucl_fp[2], *len_fp[2], *kmer_fp[2];
-  qual_type qtype=SANGER;
-  qs_set_t *qs[2];
-  gzFile fp;
-  kseq_t *seq;
+/* 
+   Returns up to top entries sorted by decreasing enrichment, and
+   stores how many in *n. Free the result with free().
+*/
+qs_enrich_t *qs_kmer_enrich(qs_set_t *qs, unsigned top, size_t *n) {
+  khash_t(str) *totals;
+  arena_t *a;
+  khiter_t t;
+  kmer_iter_t it;
+  kmer_rec_t rec;
+  uint64_t *pos_total, grand = 0;
+  qs_enrich_t *heap, e;
+  char *kmer;
+  size_t nh = 0, n_rec = 0;
+  int ret;
 
-  if (argc == 1) return usage();
+  *n = 0;
+  if (!qs->k || !top) return NULL;
+  enrich_k = qs->k;
+  if (qs->sk) return sketch_enrich(qs, top, n);
 
-  while ((c = getopt(argc, argv, "q:k:p:efsi")) >= 0) {
-    switch (c) {
-    case 'q':
-      if (strcmp(optarg, "illumina") == 0)
-	qtype = ILLUMINA;
-      else if (strcmp(optarg, "solexa") == 0)
-	qtype = SOLEXA;
-      else if (strcmp(optarg, "sanger") == 0)
-	qtype = SANGER;
-      else {
-	fprintf(stderr, "Unknown quality type '%s'.\n", optarg);
-	return(1);
-      }
-      break;
-    case 'f':
-      qtype = NONE;
-      break;
-    case 'k':
-      k = atoi(optarg);
-      break;
-    case 's':
-      strict = 1;
-      break;
-    case 'i':
-      interleaved = 1;
-      break;
-    case 'e':
-      emit = 1;
-      break;
-    case 'p':
-      prefix = calloc(strlen(optarg)+2, sizeof(char));
-      sprintf(prefix, "%s_", optarg);
-      has_prefix = 1;
-      break;
-    case 'h':
-    default:
-      return usage();
+  kmer = malloc(qs->k + 1);
+  kmer[qs->k] = 0;
+
+  /* pass 1: per-k-mer and per-position totals */
+  totals = kh_init(str);
+  a = arena_init(0);
+  pos_total = calloc(qs->l, sizeof(uint64_t));
+  kmer_iter_init(&it, qs, 0);
+  while (kmer_iter_next(&it, &rec)) {
+    pos_total[qs_row(qs, rec.pos-1)] += rec.count;
+    grand += rec.count;
+    n_rec++;
+    memcpy(kmer, rec.kmer, qs->k);
+    t = kh_put(str, totals, kmer, &ret);
+    if (ret) {
+      kh_key(totals, t) = arena_strndup(a, kmer, qs->k);
+      kh_value(totals, t) = 0;
     }
+    kh_value(totals, t) += rec.count;
   }
+  kmer_iter_destroy(&it);
 
-  if (argc == optind) return usage();
-  fp = strcmp(argv[optind], "-") ? gzopen(argv[optind], "r") : gzdopen(fileno(stdin), "r");
-
-  int n = strlen(prefix) + 2*interleaved + 9;
-  if (qtype != NONE)
-    qual_fn = calloc(n, sizeof(char));
-  nucl_fn = calloc(n, sizeof(char));
-  len_fn = calloc(n, sizeof(char));
-  if (k)
-    kmer_fn = calloc(n, sizeof(char));
-  
-  char *suffix = calloc(7, sizeof(char));
-  for (pr = 0; pr < interleaved+1; pr++) {
-    if (interleaved)
-      sprintf(suffix, "_%d.txt", pr+1);
-    else
-      sprintf(suffix, ".txt");
-    
-    if (qtype != NONE)
-      sprintf(qual_fn, "%squal%s", prefix, suffix);
-    sprintf(nucl_fn, "%snucl%s", prefix, suffix);
-    sprintf(len_fn, "%slen%s", prefix, suffix);
-    if (k)
-      sprintf(kmer_fn, "%skmer%s", prefix, suffix);
-    
-    if (qtype != NONE) {
-      qual_fp[pr] = fopen(qual_fn, "w");
-      check_fopen(qual_fp[pr]);
-    }
-    nucl_fp[pr] = fopen(nucl_fn, "w");
-    check_fopen(nucl_fn[pr]);
-    len_fp[pr] = fopen(len_fn, "w");
-    check_fopen(len_fn[pr]);
-    if (k) {
-      kmer_fp[pr] = fopen(kmer_fn, "w");
-      check_fopen(kmer_fp[pr]);
-    }
-    
+  /* pass 2: bounded heap of the most enriched entries */
+  if (top > n_rec) top = n_rec;
+  heap = enrich_alloc(top, qs->k);
+  kmer_iter_init(&it, qs, 0);
+  while (kmer_iter_next(&it, &rec)) {
+    if (rec.count < ENRICH_MIN_COUNT) continue;
+    e.obs = rec.count;
+    e.pos = rec.pos;
+    memcpy(kmer, rec.kmer, qs->k);
+    e.key = kmer;
+    t = kh_get(str, totals, kmer);
+    e.exp = (double) kh_value(totals, t) * pos_total[qs_row(qs, e.pos-1)] / grand;
+    e.ratio = e.obs / e.exp;
+    enrich_push(heap, &nh, top, &e);
   }
-  free(suffix); 
-  if (has_prefix) free(prefix);
+  kmer_iter_destroy(&it);
+  enrich_sort(heap, nh);
+
+  kh_destroy(str, totals);
+  arena_destroy(a);
+  free(pos_total);
+  free(kmer);
+  *n = nh;
+  return heap;
+}
+
+/* 
+   Output buffering. Tables are formatted into a kstring_t with a
+   hand-rolled integer formatter and handed to fwrite() in large
+   blocks, rather than calling fprintf() once per cell.
+*/
+#define OUTBUF_SIZE (1<<22)
 
-  if (has_prefix) {
-    if (qtype != NONE) free(qual_fn);
-    free(nucl_fn); free(len_fn); 
-    if (k) free(kmer_fn);
+static const char digit_pairs[] =
+  "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+  "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+  "8081828384858687888990919293949596979899";
+
+static inline void kgrow(kstring_t *s, size_t n) {
+  if (s->l + n + 1 > s->m) {
+    s->m = s->l + n + 1;
+    kroundup32(s->m);
+    s->s = realloc(s->s, s->m);
   }
-  
-  qs[0] = qs_init(qtype, k);
-  if (interleaved) {
-    qs[1] = qs_init(qtype, k);
+}
+
+static inline void kputsn(const char *p, size_t n, kstring_t *s) {
+  kgrow(s, n);
+  memcpy(s->s + s->l, p, n);
+  s->l += n;
+  s->s[s->l] = 0;
+}
+
+static inline void kputs(const char *p, kstring_t *s) {
+  kputsn(p, strlen(p), s);
+}
+
+static inline void kputc(int c, kstring_t *s) {
+  kgrow(s, 1);
+  s->s[s->l++] = c;
+  s->s[s->l] = 0;
+}
+
+static inline void kputu64(uint64_t x, kstring_t *s) {
+  char buf[20], *p = buf + 20;
+  unsigned r;
+  while (x >= 100) {
+    r = (unsigned) (x % 100);
+    x /= 100;
+    p -= 2;
+    memcpy(p, digit_pairs + 2*r, 2);
   }
-  seq = kseq_init(fp);
+  if (x >= 10) {
+    p -= 2;
+    memcpy(p, digit_pairs + 2*x, 2);
+  } else {
+    *--p = '0' + (char) x;
+  }
+  kputsn(p, buf + 20 - p, s);
+}
 
-  while (kseq_read(seq) >= 0) {
-    if (strict) rname = strdup(seq->seq.s);
-    qs_update(qs[0], seq, strict);
-    if (emit) qs_printseq(seq, seq->seq.l);
-    rname = strdup(seq->name.s);
+static inline void kputint(int x, kstring_t *s) {
+  if (x < 0) {
+    kputc('-', s);
+    kputu64((uint64_t) -(int64_t) x, s);
+  } else {
+    kputu64((uint64_t) x, s);
+  }
+}
 
-    /* for interleaved files, grab and process another entry */
-    if (interleaved) {
-      if (kseq_read(seq) >= 0) {
-	qs_update(qs[1], seq, strict);
-	if (emit) qs_printseq(seq, seq->seq.l);
-	if (!is_interleaved_pair(rname, seq->name.s)) {
-	  fprintf(stderr, "[%s] warning: interleaved reads names differ '%s' != '%s'\n", __func__, rname, seq->name.s);
-	  if (strict) return 1;
-	}
-      } else {
-	fprintf(stderr, "[%s] error: interleaved file length not multiple of two.", __func__);
-	return 1;
-      }
+static inline void kputf(double x, kstring_t *s) {
+  char buf[32];
+  kputsn(buf, snprintf(buf, sizeof(buf), "%.4g", x), s);
+}
+
+/* 
+   A quoted JSON string. K-mers and read starts are raw input bytes, so
+   quotes, backslashes, control bytes, and bytes past ASCII (which need
+   not be valid UTF-8) are escaped; the last are read as Latin-1.
+*/
+static void kputjson(const char *p, size_t n, kstring_t *s) {
+  static const char hex[] = "0123456789abcdef";
+  size_t i;
+  unsigned char c;
+  kputc('"', s);
+  for (i = 0; i < n; i++) {
+    c = (unsigned char) p[i];
+    if (c == '"' || c == '\\') {
+      kputc('\\', s);
+      kputc(c, s);
+    } else if (c < 0x20 || c >= 0x7f) {
+      kputs("\\u00", s);
+      kputc(hex[c >> 4], s);
+      kputc(hex[c & 15], s);
+    } else {
+      kputc(c, s);
     }
-    free(rname);
   }
-  
-  for (pr = 0; pr < interleaved+1; pr++) {
-    qs_ntm_fprint(nucl_fp[pr], qs[pr]);
-    if (has_qual(qs[pr]))
-      qs_qm_fprint(qual_fp[pr], qs[pr]);
-    qs_lm_fprint(len_fp[pr], qs[pr]);
-    if (k) qs_kmer_fprint(kmer_fp[pr], qs[pr]);
-    qs_destroy(qs[pr]);
-    if (qtype != NONE) 
-      fclose(qual_fp[pr]); 
-    fclose(nucl_fp[pr]); fclose(len_fp[pr]); 
-    if (k) fclose(kmer_fp[pr]);
+  kputc('"', s);
+}
+
+/* little-endian fixed width integers, for the binary format */
+static inline void kputle(uint64_t x, int width, kstring_t *s) {
+  int i;
+  kgrow(s, width);
+  for (i = 0; i < width; i++)
+    s->s[s->l++] = (char) ((x >> (8*i)) & 0xff);
+  s->s[s->l] = 0;
+}
+
+static inline void kflush(kstring_t *s, FILE *file, int force) {
+  if (s->l && (force || s->l >= OUTBUF_SIZE)) {
+    fwrite(s->s, 1, s->l, file);
+    s->l = 0;
+  }
+}
+
+static void qs_qm_header(kstring_t *out, qs_set_t *qs, const char *sep, const char *quote) {
+  unsigned j;
+  for (j = 0; j < qrng(qs->qt); j++) {
+    kputs(quote, out);
+    kputc('Q', out);
+    kputint(j + qoffset(qs->qt) + qmin(qs->qt), out);
+    kputs(quote, out);
+    if (j < qrng(qs->qt)-1) kputs(sep, out);
+  }
+}
+
+static void qs_ntm_header(kstring_t *out, const char *sep, const char *quote) {
+  unsigned j;
+  for (j = 0; j < 17; ++j) {
+    kputs(quote, out);
+    kputc(seq_nt17_rev_table[j], out);
+    kputs(quote, out);
+    if (j < 16) kputs(sep, out);
+  }
+}
+
+/* 1-indexed start and end position columns of a binned row */
+static void qs_pos_label(kstring_t *out, unsigned i) {
+  kputu64(bin_start(i) + 1, out);
+  kputc('\t', out);
+  kputu64(bin_start(i+1), out);
+  kputc('\t', out);
+}
+
+static void qs_matrix_rows(kstring_t *out, FILE *file, qs_set_t *qs, uint64_t **m, unsigned ncol) {
+  unsigned i, j;
+  for (i = 0; i < qs->l; i++) {
+    if (qs->binned) qs_pos_label(out, i);
+    for (j = 0; j < ncol; j++) {
+      kputu64(m[i][j], out);
+      if (j < ncol-1) kputc('\t', out);
+    }
+    kputc('\n', out);
+    kflush(out, file, 0);
+  }
+}
+
+void qs_qm_fprint(FILE *file, qs_set_t *qs) {
+  kstring_t out = {0, 0, 0};
+  
+  if (!has_qual(qs)) return;
+
+  if (qs->binned) kputs("start\tend\t", &out);
+  qs_qm_header(&out, qs, "\t", "");
+  kputc('\n', &out);
+  qs_matrix_rows(&out, file, qs, qs->qm, qrng(qs->qt));
+  kputc('\n', &out);
+  kflush(&out, file, 1);
+  free(out.s);
+}
+
+void qs_ntm_fprint(FILE *file, qs_set_t *qs) {
+  kstring_t out = {0, 0, 0};
+
+  if (qs->binned) kputs("start\tend\t", &out);
+  qs_ntm_header(&out, "\t", "");
+  kputc('\n', &out);
+  qs_matrix_rows(&out, file, qs, qs->ntm, 17);
+  kputc('\n', &out);
+  kflush(&out, file, 1);
+  free(out.s);
+}
+
+void qs_lm_fprint(FILE *file, qs_set_t *qs) {
+  unsigned i;
+  kstring_t out = {0, 0, 0};
+  kputs(qs->binned ? "start\tend\tcount\n" : "pos\tcount\n", &out);
+  for (i = 0; i < qs->l; i++) {
+    if (qs->binned) {
+      qs_pos_label(&out, i);
+    } else {
+      kputu64(i+1, &out);
+      kputc('\t', &out);
+    }
+    kputu64(qs->lm[i], &out);
+    kputc('\n', &out);
+    kflush(&out, file, 0);
+  }
+  kputc('\n', &out);
+  kflush(&out, file, 1);
+  free(out.s);
+}
+
+/* 
+   Run totals as (name, value) pairs, shared by the writers.
+*/
+unsigned qs_summary(const qs_set_t *qs, const char **names, uint64_t *vals) {
+  unsigned n = 0;
+  names[n] = "reads"; vals[n++] = qs->n_reads;
+  names[n] = "sampled_reads"; vals[n++] = qs->n_sampled;
+  names[n] = "bases"; vals[n++] = qs->n_bases;
+  if (qs->converge_tol > 0) {
+    names[n] = "converged_at"; vals[n++] = qs->converged_at;
+  }
+  return n;
+}
+
+void qs_summary_fprint(FILE *file, qs_set_t *qs) {
+  unsigned i, n;
+  const char *names[QS_SUMMARY_MAX];
+  uint64_t vals[QS_SUMMARY_MAX];
+  kstring_t out = {0, 0, 0};
+  n = qs_summary(qs, names, vals);
+  for (i = 0; i < n; i++) {
+    kputs(names[i], &out);
+    kputc('\t', &out);
+    kputu64(vals[i], &out);
+    kputc('\n', &out);
+  }
+  kputc('\n', &out);
+  kflush(&out, file, 1);
+  free(out.s);
+}
+
+/* 
+   Bounds on the true count of a tracked heavy hitter: lower <= true
+   count <= count.
+*/
+static void sketch_bounds(const qs_sketch_t *sk, uint32_t id, uint64_t *count, uint64_t *lower) {
+  uint64_t cms = sketch_query(sk, sk->keys + (size_t) id*sk->k, sk->e[id].pos);
+  *count = cms < sk->e[id].count ? cms : sk->e[id].count;
+  *lower = sk->e[id].count - sk->e[id].err;
+}
+
+/* approximate mode: heavy hitters by decreasing count, with bounds */
+static void sketch_fprint(FILE *file, qs_sketch_t *sk) {
+  size_t i;
+  uint32_t *ids = sketch_sorted(sk);
+  uint64_t count, lower;
+  kstring_t out = {0, 0, 0};
+  kputs("kmer\tpos\tcount\tlower\n", &out);
+  for (i = 0; i < sk->n; i++) {
+    sketch_bounds(sk, ids[i], &count, &lower);
+    kputsn(sk->keys + (size_t) ids[i]*sk->k, sk->k, &out);
+    kputc('\t', &out);
+    kputu64(sk->e[ids[i]].pos, &out);
+    kputc('\t', &out);
+    kputu64(count, &out);
+    kputc('\t', &out);
+    kputu64(lower, &out);
+    kputc('\n', &out);
+    kflush(&out, file, 0);
+  }
+  kputc('\n', &out);
+  kflush(&out, file, 1);
+  free(out.s);
+  free(ids);
+}
+
+typedef struct {
+  const char *seq;
+  unsigned len;
+  uint64_t count, lower; /* count - lower <= the error bound */
+  double frac;
+} qs_over_t;
+
+/* tracked prefixes whose count reaches over_frac of the reads, most frequent first */
+static qs_over_t *qs_overrep(const qs_set_t *qs, size_t *n) {
+  const qs_sketch_t *sk = qs->over;
+  uint32_t *ids = sketch_sorted(sk);
+  qs_over_t *o = malloc((sk->n + 1)*sizeof(qs_over_t));
+  size_t i;
+  for (i = *n = 0; i < sk->n; i++) {
+    const ss_entry_t *e = &sk->e[ids[i]];
+    if (e->count < qs->over_frac*sk->total) break;
+    o[*n].seq = sk->keys + (size_t) ids[i]*sk->k;
+    o[*n].len = e->pos;
+    o[*n].count = e->count;
+    o[*n].lower = e->count - e->err;
+    o[(*n)++].frac = (double) e->count/sk->total;
+  }
+  free(ids);
+  return o;
+}
+
+void qs_overrep_fprint(FILE *file, qs_set_t *qs) {
+  size_t i, n;
+  qs_over_t *o;
+  kstring_t out = {0, 0, 0};
+  if (!qs->over) return;
+  o = qs_overrep(qs, &n);
+  kputs("sequence\tcount\tlower\tfraction\n", &out);
+  for (i = 0; i < n; i++) {
+    kputsn(o[i].seq, o[i].len, &out);
+    kputc('\t', &out);
+    kputu64(o[i].count, &out);
+    kputc('\t', &out);
+    kputu64(o[i].lower, &out);
+    kputc('\t', &out);
+    kputf(o[i].frac, &out);
+    kputc('\n', &out);
+  }
+  kputc('\n', &out);
+  kflush(&out, file, 1);
+  free(out.s);
+  free(o);
+}
+
+/*
+   Three tables: reads by the length and base of their trailing run,
+   poly-G tails by the position they start at (with the fraction of
+   reads having one that started there or earlier), and reads by their
+   highest DUST window score.
+*/
+void qs_complexity_fprint(FILE *file, qs_set_t *qs) {
+  const complexity_t *cx = qs->cx;
+  uint64_t cum = 0;
+  size_t i, n;
+  unsigned j;
+  kstring_t out = {0, 0, 0};
+  if (!cx) return;
+
+  kputs("run\tA\tC\tG\tT\tN\n", &out);
+  for (n = cx->m_run; n > 1; n--) {
+    for (j = 0; j < 5 && !cx->run[(n-1)*5 + j]; j++);
+    if (j < 5) break;
+  }
+  for (i = 1; i < n; i++) {
+    kputu64(i, &out);
+    for (j = 0; j < 5; j++) {
+      kputc('\t', &out);
+      kputu64(cx->run[i*5 + j], &out);
+    }
+    kputc('\n', &out);
+    kflush(&out, file, 0);
+  }
+
+  kputs(qs->binned ? "\nstart\tend\tpolyg\tfraction\n" : "\npos\tpolyg\tfraction\n", &out);
+  for (n = cx->m_onset; n > 0 && !cx->onset[n-1]; n--);
+  for (i = 0; i < n; i++) {
+    if (qs->binned) {
+      qs_pos_label(&out, i);
+    } else {
+      kputu64(i+1, &out);
+      kputc('\t', &out);
+    }
+    kputu64(cx->onset[i], &out);
+    kputc('\t', &out);
+    kputf((double) (cum += cx->onset[i])/cx->n_reads, &out);
+    kputc('\n', &out);
+    kflush(&out, file, 0);
+  }
+
+  kputs("\ndust\treads\n", &out);
+  for (j = 0; j < CX_SCORES; j++) {
+    kputu64(j, &out);
+    kputc('\t', &out);
+    kputu64(cx->score[j], &out);
+    kputc('\n', &out);
+  }
+  kputc('\n', &out);
+  kflush(&out, file, 1);
+  free(out.s);
+  fprintf(stderr, "[%s] %llu reads: %llu (%.2f%%) end in a poly-G tail, %llu (%.2f%%) are low-complexity (DUST > %d)\n", __func__,
+	  (long long unsigned int) cx->n_reads, (long long unsigned int) cx->n_polyg,
+	  cx->n_reads ? 100.0*cx->n_polyg/cx->n_reads : 0, (long long unsigned int) cx->n_low,
+	  cx->n_reads ? 100.0*cx->n_low/cx->n_reads : 0, CX_LOW);
+}
+
+void qs_kmer_fprint(FILE *file, qs_set_t *qs) {
+  if (!qs->k) return;
+  if (qs->sk) {
+    sketch_fprint(file, qs->sk);
+    return;
+  }
+  kmer_iter_t it;
+  kmer_rec_t rec;
+  kstring_t out = {0, 0, 0};
+  kputs("kmer\tpos\tcount\n", &out);
+  kmer_iter_init(&it, qs, 1);
+  while (kmer_iter_next(&it, &rec)) {
+    kputsn(rec.kmer, qs->k, &out);
+    kputc('\t', &out);
+    kputu64(rec.pos, &out);
+    kputc('\t', &out);
+    kputu64(rec.count, &out);
+    kputc('\n', &out);
+    kflush(&out, file, 0);
+  }
+  kmer_iter_destroy(&it);
+  kputc('\n', &out);
+  kflush(&out, file, 1);
+  free(out.s);
+}
+
+void qs_enrich_fprint(FILE *file, qs_set_t *qs, unsigned top) {
+  size_t i, n;
+  qs_enrich_t *e;
+  kstring_t out = {0, 0, 0};
+  if (!qs->k) return;
+  e = qs_kmer_enrich(qs, top, &n);
+  kputs("kmer\tpos\tobserved\texpected\tratio\n", &out);
+  for (i = 0; i < n; i++) {
+    kputsn(e[i].key, qs->k, &out);
+    kputc('\t', &out);
+    kputu64(e[i].pos, &out);
+    kputc('\t', &out);
+    kputu64(e[i].obs, &out);
+    kputc('\t', &out);
+    kputf(e[i].exp, &out);
+    kputc('\t', &out);
+    kputf(e[i].ratio, &out);
+    kputc('\n', &out);
+    kflush(&out, file, 0);
+  }
+  kputc('\n', &out);
+  kflush(&out, file, 1);
+  free(out.s);
+  free(e);
+}
+
+/* 
+   JSON output: a single document holding every statistics set (one,
+   or two with interleaved input). Each table is an object with
+   "columns" and row-major "rows".
+*/
+static void qs_json_matrix(kstring_t *out, FILE *file, uint64_t **m, unsigned nrow, unsigned ncol) {
+  unsigned i, j;
+  kputs("\"rows\": [", out);
+  for (i = 0; i < nrow; i++) {
+    kputc('[', out);
+    for (j = 0; j < ncol; j++) {
+      kputu64(m[i][j], out);
+      if (j < ncol-1) kputc(',', out);
+    }
+    kputc(']', out);
+    if (i < nrow-1) kputc(',', out);
+    kflush(out, file, 0);
+  }
+  kputc(']', out);
+}
+
+static void qs_json_set(kstring_t *out, FILE *file, qs_set_t *qs, const qs_outopt_t *opt) {
+  unsigned i, n;
+  size_t ne;
+  const char *names[QS_SUMMARY_MAX];
+  uint64_t vals[QS_SUMMARY_MAX];
+  kmer_iter_t it;
+  kmer_rec_t rec;
+  qs_enrich_t *e;
+
+  kputs("{\"summary\": {", out);
+  n = qs_summary(qs, names, vals);
+  for (i = 0; i < n; i++) {
+    if (i) kputs(", ", out);
+    kputc('"', out);
+    kputs(names[i], out);
+    kputs("\": ", out);
+    kputu64(vals[i], out);
+  }
+  kputs("}, ", out);
+  if (qs->binned) {
+    kputs("\"bins\": {\"columns\": [\"start\",\"end\"], \"rows\": [", out);
+    for (i = 0; i < qs->l; i++) {
+      kputc('[', out);
+      kputu64(bin_start(i) + 1, out);
+      kputc(',', out);
+      kputu64(bin_start(i+1), out);
+      kputc(']', out);
+      if (i < qs->l-1) kputc(',', out);
+    }
+    kputs("]}, ", out);
+  }
+  kputs("\"nucl\": {\"columns\": [", out);
+  qs_ntm_header(out, ",", "\"");
+  kputs("], ", out);
+  qs_json_matrix(out, file, qs->ntm, qs->l, 17);
+  kputc('}', out);
+
+  if (has_qual(qs)) {
+    kputs(", \"qual\": {\"columns\": [", out);
+    qs_qm_header(out, qs, ",", "\"");
+    kputs("], ", out);
+    qs_json_matrix(out, file, qs->qm, qs->l, qrng(qs->qt));
+    kputc('}', out);
+  }
+
+  kputs(", \"len\": {\"columns\": [\"pos\",\"count\"], \"rows\": [", out);
+  for (i = 0; i < qs->l; i++) {
+    kputc('[', out);
+    kputu64(i+1, out);
+    kputc(',', out);
+    kputu64(qs->lm[i], out);
+    kputc(']', out);
+    if (i < qs->l-1) kputc(',', out);
+    kflush(out, file, 0);
+  }
+  kputs("]}", out);
+
+  if (qs->k) {
+    e = qs_kmer_enrich(qs, opt->kmer_top, &ne);
+    kputs(", \"kmer_enrich\": {\"columns\": [\"kmer\",\"pos\",\"observed\",\"expected\",\"ratio\"], \"rows\": [", out);
+    for (i = 0; i < ne; i++) {
+      if (i) kputc(',', out);
+      kputc('[', out);
+      kputjson(e[i].key, qs->k, out);
+      kputc(',', out);
+      kputu64(e[i].pos, out);
+      kputc(',', out);
+      kputu64(e[i].obs, out);
+      kputc(',', out);
+      kputf(e[i].exp, out);
+      kputc(',', out);
+      kputf(e[i].ratio, out);
+      kputc(']', out);
+    }
+    kputs("]}", out);
+    free(e);
+  }
+
+  if (qs->over) {
+    qs_over_t *o = qs_overrep(qs, &ne);
+    kputs(", \"overrep\": {\"columns\": [\"sequence\",\"count\",\"lower\",\"fraction\"], \"rows\": [", out);
+    for (i = 0; i < ne; i++) {
+      if (i) kputc(',', out);
+      kputc('[', out);
+      kputjson(o[i].seq, o[i].len, out);
+      kputc(',', out);
+      kputu64(o[i].count, out);
+      kputc(',', out);
+      kputu64(o[i].lower, out);
+      kputc(',', out);
+      kputf(o[i].frac, out);
+      kputc(']', out);
+    }
+    kputs("]}", out);
+    free(o);
+  }
+
+  if (qs->sk && opt->kmer_dump) {
+    uint32_t *ids = sketch_sorted(qs->sk);
+    uint64_t count, lower;
+    kputs(", \"kmer\": {\"columns\": [\"kmer\",\"pos\",\"count\",\"lower\"], \"rows\": [", out);
+    for (i = 0; i < qs->sk->n; i++) {
+      sketch_bounds(qs->sk, ids[i], &count, &lower);
+      if (i) kputc(',', out);
+      kputc('[', out);
+      kputjson(qs->sk->keys + (size_t) ids[i]*qs->k, qs->k, out);
+      kputc(',', out);
+      kputu64(qs->sk->e[ids[i]].pos, out);
+      kputc(',', out);
+      kputu64(count, out);
+      kputc(',', out);
+      kputu64(lower, out);
+      kputc(']', out);
+      kflush(out, file, 0);
+    }
+    kputs("]}", out);
+    free(ids);
+  } else if (qs->k && opt->kmer_dump) {
+    kputs(", \"kmer\": {\"columns\": [\"kmer\",\"pos\",\"count\"], \"rows\": [", out);
+    kmer_iter_init(&it, qs, 1);
+    for (n = 0; kmer_iter_next(&it, &rec); n++) {
+      if (n) kputc(',', out);
+      kputc('[', out);
+      kputjson(rec.kmer, qs->k, out);
+      kputc(',', out);
+      kputu64(rec.pos, out);
+      kputc(',', out);
+      kputu64(rec.count, out);
+      kputc(']', out);
+      kflush(out, file, 0);
+    }
+    kmer_iter_destroy(&it);
+    kputs("]}", out);
+  }
+  kputc('}', out);
+}
+
+void qs_json_fprint(FILE *file, qs_set_t **qs, int n, const qs_outopt_t *opt) {
+  int i;
+  kstring_t out = {0, 0, 0};
+  kputs("{\"version\": \"", &out);
+  kputs(STR(VERSION), &out);
+  kputs("\", \"sets\": [", &out);
+  for (i = 0; i < n; i++) {
+    if (i) kputs(", ", &out);
+    qs_json_set(&out, file, qs[i], opt);
+  }
+  kputs("]}\n", &out);
+  kflush(&out, file, 1);
+  free(out.s);
+}
+
+/* 
+   Columnar binary output. All integers are little-endian.
+
+     file:   "SQQS" u32:version u32:n_sets set*
+     set:    u32:n_tables table*
+     table:  u8:name_len name u32:n_cols u64:n_rows column-header* column-data*
+     column-header:  u8:name_len name u8:type u32:width
+     column-data:    n_rows values, one whole column after another
+
+   Column type 0 is a u64 (width 8), type 1 is a fixed-width,
+   unterminated string (width bytes each), and type 2 is an IEEE 754
+   double (width 8).
+*/
+#define QS_BIN_VERSION 1
+#define QS_BIN_U64 0
+#define QS_BIN_STR 1
+#define QS_BIN_F64 2
+
+static inline void kputle_f64(double x, kstring_t *s) {
+  uint64_t u;
+  memcpy(&u, &x, sizeof(u));
+  kputle(u, 8, s);
+}
+
+static void qs_bin_name(kstring_t *out, const char *name, size_t len) {
+  kputle(len, 1, out);
+  kputsn(name, len, out);
+}
+
+static void qs_bin_table(kstring_t *out, const char *name, unsigned ncol, uint64_t nrow) {
+  qs_bin_name(out, name, strlen(name));
+  kputle(ncol, 4, out);
+  kputle(nrow, 8, out);
+}
+
+static void qs_bin_column(kstring_t *out, const char *name, size_t len, int type, unsigned width) {
+  qs_bin_name(out, name, len);
+  kputle(type, 1, out);
+  kputle(width, 4, out);
+}
+
+static void qs_bin_matrix(kstring_t *out, FILE *file, uint64_t **m, unsigned nrow, unsigned ncol) {
+  unsigned i, j;
+  for (j = 0; j < ncol; j++) {
+    for (i = 0; i < nrow; i++) {
+      kputle(m[i][j], 8, out);
+      kflush(out, file, 0);
+    }
+  }
+}
+
+static void qs_bin_set(kstring_t *out, FILE *file, qs_set_t *qs, const qs_outopt_t *opt) {
+  unsigned i, j, n;
+  size_t ne;
+  const char *names[QS_SUMMARY_MAX];
+  uint64_t vals[QS_SUMMARY_MAX];
+  char name[8];
+  kmer_iter_t it;
+  kmer_rec_t rec;
+  qs_enrich_t *e;
+
+  kputle(3 + qs->binned + has_qual(qs) + (qs->k > 0) + (qs->over != NULL) + (qs->k > 0 && opt->kmer_dump), 4, out);
+
+  n = qs_summary(qs, names, vals);
+  qs_bin_table(out, "summary", n, 1);
+  for (j = 0; j < n; j++)
+    qs_bin_column(out, names[j], strlen(names[j]), QS_BIN_U64, 8);
+  for (j = 0; j < n; j++) kputle(vals[j], 8, out);
+
+  if (qs->binned) {
+    qs_bin_table(out, "bins", 2, qs->l);
+    qs_bin_column(out, "start", 5, QS_BIN_U64, 8);
+    qs_bin_column(out, "end", 3, QS_BIN_U64, 8);
+    for (i = 0; i < qs->l; i++) kputle(bin_start(i) + 1, 8, out);
+    for (i = 0; i < qs->l; i++) kputle(bin_start(i+1), 8, out);
+  }
+
+  qs_bin_table(out, "nucl", 17, qs->l);
+  for (j = 0; j < 17; j++)
+    qs_bin_column(out, seq_nt17_rev_table + j, 1, QS_BIN_U64, 8);
+  qs_bin_matrix(out, file, qs->ntm, qs->l, 17);
+
+  if (has_qual(qs)) {
+    qs_bin_table(out, "qual", qrng(qs->qt), qs->l);
+    for (j = 0; j < qrng(qs->qt); j++) {
+      sprintf(name, "Q%d", j + qoffset(qs->qt) + qmin(qs->qt));
+      qs_bin_column(out, name, strlen(name), QS_BIN_U64, 8);
+    }
+    qs_bin_matrix(out, file, qs->qm, qs->l, qrng(qs->qt));
+  }
+
+  qs_bin_table(out, "len", 2, qs->l);
+  qs_bin_column(out, "pos", 3, QS_BIN_U64, 8);
+  qs_bin_column(out, "count", 5, QS_BIN_U64, 8);
+  for (i = 0; i < qs->l; i++) kputle(i+1, 8, out);
+  for (i = 0; i < qs->l; i++) kputle(qs->lm[i], 8, out);
+  kflush(out, file, 0);
+
+  if (qs->k) {
+    e = qs_kmer_enrich(qs, opt->kmer_top, &ne);
+    qs_bin_table(out, "kmer_enrich", 5, ne);
+    qs_bin_column(out, "kmer", 4, QS_BIN_STR, qs->k);
+    qs_bin_column(out, "pos", 3, QS_BIN_U64, 8);
+    qs_bin_column(out, "observed", 8, QS_BIN_U64, 8);
+    qs_bin_column(out, "expected", 8, QS_BIN_F64, 8);
+    qs_bin_column(out, "ratio", 5, QS_BIN_F64, 8);
+    for (i = 0; i < ne; i++) kputsn(e[i].key, qs->k, out);
+    for (i = 0; i < ne; i++) kputle(e[i].pos, 8, out);
+    for (i = 0; i < ne; i++) kputle(e[i].obs, 8, out);
+    for (i = 0; i < ne; i++) kputle_f64(e[i].exp, out);
+    for (i = 0; i < ne; i++) kputle_f64(e[i].ratio, out);
+    kflush(out, file, 0);
+    free(e);
+  }
+
+  if (qs->over) {
+    qs_over_t *o = qs_overrep(qs, &ne);
+    qs_bin_table(out, "overrep", 4, ne);
+    qs_bin_column(out, "sequence", 8, QS_BIN_STR, OVER_LEN);
+    qs_bin_column(out, "count", 5, QS_BIN_U64, 8);
+    qs_bin_column(out, "lower", 5, QS_BIN_U64, 8);
+    qs_bin_column(out, "fraction", 8, QS_BIN_F64, 8);
+    /* fixed width, so shorter sequences are padded with NULs */
+    for (i = 0; i < ne; i++) kputsn(o[i].seq, OVER_LEN, out);
+    for (i = 0; i < ne; i++) kputle(o[i].count, 8, out);
+    for (i = 0; i < ne; i++) kputle(o[i].lower, 8, out);
+    for (i = 0; i < ne; i++) kputle_f64(o[i].frac, out);
+    kflush(out, file, 0);
+    free(o);
+  }
+
+  if (qs->sk && opt->kmer_dump) {
+    uint32_t *ids = sketch_sorted(qs->sk);
+    uint64_t count, lower;
+    qs_bin_table(out, "kmer", 4, qs->sk->n);
+    qs_bin_column(out, "kmer", 4, QS_BIN_STR, qs->k);
+    qs_bin_column(out, "pos", 3, QS_BIN_U64, 8);
+    qs_bin_column(out, "count", 5, QS_BIN_U64, 8);
+    qs_bin_column(out, "lower", 5, QS_BIN_U64, 8);
+    for (j = 0; j < 4; j++) {
+      for (i = 0; i < qs->sk->n; i++) {
+	sketch_bounds(qs->sk, ids[i], &count, &lower);
+	if (j == 0) kputsn(qs->sk->keys + (size_t) ids[i]*qs->k, qs->k, out);
+	else if (j == 1) kputle(qs->sk->e[ids[i]].pos, 8, out);
+	else kputle(j == 2 ? count : lower, 8, out);
+	kflush(out, file, 0);
+      }
+    }
+    free(ids);
+  } else if (qs->k && opt->kmer_dump) {
+    uint64_t nrec = 0;
+    kmer_iter_init(&it, qs, 0);
+    while (kmer_iter_next(&it, &rec)) nrec++;
+    kmer_iter_destroy(&it);
+    qs_bin_table(out, "kmer", 3, nrec);
+    qs_bin_column(out, "kmer", 4, QS_BIN_STR, qs->k);
+    qs_bin_column(out, "pos", 3, QS_BIN_U64, 8);
+    qs_bin_column(out, "count", 5, QS_BIN_U64, 8);
+    for (j = 0; j < 3; j++) {
+      kmer_iter_init(&it, qs, 1);
+      while (kmer_iter_next(&it, &rec)) {
+	if (j == 0) kputsn(rec.kmer, qs->k, out);
+	else if (j == 1) kputle(rec.pos, 8, out);
+	else kputle(rec.count, 8, out);
+	kflush(out, file, 0);
+      }
+      kmer_iter_destroy(&it);
+    }
+  }
+}
+
+void qs_bin_fprint(FILE *file, qs_set_t **qs, int n, const qs_outopt_t *opt) {
+  int i;
+  kstring_t out = {0, 0, 0};
+  kputs("SQQS", &out);
+  kputle(QS_BIN_VERSION, 4, &out);
+  kputle(n, 4, &out);
+  for (i = 0; i < n; i++)
+    qs_bin_set(&out, file, qs[i], opt);
+  kflush(&out, file, 1);
+  free(out.s);
+}
+
+
+/* 
+   Checkpoints: the counters, matrices, convergence snapshot, and exact
+   k-mer hash of a set, as native-endian words (a checkpoint is only
+   meant to be resumed on the machine that wrote it). Approximate,
+   spilled, and spectrum k-mer counts are not saved.
+*/
+static int ck_write(FILE *fp, const void *p, size_t size) {
+  return fwrite(p, 1, size, fp) == size ? 0 : -1;
+}
+
+static int ck_read(FILE *fp, void *p, size_t size) {
+  return fread(p, 1, size, fp) == size ? 0 : -1;
+}
+
+int qs_checkpoint_write(FILE *fp, const qs_set_t *qs) {
+  unsigned i, nq = has_qual(qs) ? qrng(qs->qt) : 0;
+  uint64_t v[8];
+  uint32_t len;
+  khiter_t k;
+  int err = 0;
+
+  v[0] = qs->l; v[1] = qs->n_uniq_kmer_pos; v[2] = qs->n_reads;
+  v[3] = qs->n_sampled; v[4] = qs->n_bases; v[5] = qs->converged_at;
+  v[6] = qs->snap ? qs->snap_l : 0; v[7] = qs->h ? kh_size(qs->h) : 0;
+  err |= ck_write(fp, v, sizeof(v));
+  err |= ck_write(fp, qs->lm, qs->l*sizeof(uint64_t));
+  for (i = 0; i < qs->l; i++) {
+    err |= ck_write(fp, qs->ntm[i], 17*sizeof(uint64_t));
+    if (nq) err |= ck_write(fp, qs->qm[i], nq*sizeof(uint64_t));
+  }
+  if (v[6]) err |= ck_write(fp, qs->snap, v[6]*(17 + nq)*sizeof(double));
+  if (qs->h) {
+    for (k = kh_begin(qs->h); k != kh_end(qs->h); ++k) {
+      if (!kh_exist(qs->h, k)) continue;
+      len = strlen(kh_key(qs->h, k));
+      err |= ck_write(fp, &len, sizeof(len));
+      err |= ck_write(fp, kh_key(qs->h, k), len);
+      err |= ck_write(fp, &kh_value(qs->h, k), sizeof(uint64_t));
+    }
+  }
+  return err;
+}
+
+/* into a freshly initialized set with the same options */
+int qs_checkpoint_read(FILE *fp, qs_set_t *qs) {
+  unsigned i, nq = has_qual(qs) ? qrng(qs->qt) : 0;
+  uint64_t v[8], j;
+  uint32_t len;
+  khiter_t k;
+  int ret;
+
+  if (ck_read(fp, v, sizeof(v))) return -1;
+  if (v[7] && !qs->h) return -1;
+  qs_grow(qs, v[0]);
+  qs->n_uniq_kmer_pos = v[1]; qs->n_reads = v[2]; qs->n_sampled = v[3];
+  qs->n_bases = v[4]; qs->converged_at = v[5];
+  if (ck_read(fp, qs->lm, qs->l*sizeof(uint64_t))) return -1;
+  for (i = 0; i < qs->l; i++) {
+    if (ck_read(fp, qs->ntm[i], 17*sizeof(uint64_t))) return -1;
+    if (nq && ck_read(fp, qs->qm[i], nq*sizeof(uint64_t))) return -1;
+  }
+  if (v[6]) {
+    qs->snap_l = v[6];
+    qs->snap = malloc(v[6]*(17 + nq)*sizeof(double));
+    if (ck_read(fp, qs->snap, v[6]*(17 + nq)*sizeof(double))) return -1;
+  }
+  for (j = 0; j < v[7]; j++) {
+    if (ck_read(fp, &len, sizeof(len)) || len > qs->k + 11) return -1;
+    if (ck_read(fp, qs->kbuf, len)) return -1;
+    qs->kbuf[len] = '\0';
+    k = kh_put(str, qs->h, arena_strdup(qs->ka, qs->kbuf), &ret);
+    if (ck_read(fp, &kh_value(qs->h, k), sizeof(uint64_t))) return -1;
+  }
+  return 0;
+}
+
+void qs_destroy(qs_set_t *qs) {
+  if (qs->h) kh_destroy(str, qs->h);
+  free(qs->kbuf);
+  sketch_destroy(qs->sk);
+  sketch_destroy(qs->over);
+  complexity_destroy(qs->cx);
+  spill_destroy(qs->sp);
+  arena_destroy(qs->ka);
+  if (qs->qm) free(qs->qm[0]);
+  free(qs->qm);
+  free(qs->ntm[0]);
+  free(qs->ntm);
+  free(qs->lm);
+  free(qs->snap);
+  free(qs->tl);
+  free(qs);
+}
+
+#ifdef _SEQQS_MAIN
+
+int usage() {
+  fputs("\
+Usage: seqqs [options] <in.fq>\n\
+       seqqs peek [-w SEC] <live file>\n\n\
+Options: -q    quality type, either illumina, solexa, or sanger (default: sanger)\n\
+         -p    prefix for output files (default: none)\n\
+         -k    hash k-mers of length k (default: off)\n\
+         --kmer-top N  entries in the k-mer enrichment report (default: 100)\n\
+         --kmer-all    also write every positional k-mer count (default: off)\n\
+         --kmer-mem SIZE  count k-mers approximately in SIZE bytes, e.g. 512M (default: exact)\n\
+         --kmer-spill SIZE  count k-mers exactly, spilling to $TMPDIR past SIZE bytes (default: off)\n\
+         --spectrum K  whole-read canonical K-mer spectrum, K <= 31 (default: off)\n\
+         -t    threads for the k-mer spectrum and for decompressing BGZF or zstd (default: 1)\n\
+         --sample-frac F  accumulate statistics on a random fraction F of reads (default: all)\n\
+         --sample-n N  accumulate statistics on a uniform random sample of N reads (default: all)\n\
+         --converge TOL  stop accumulating once no normalized base or quality proportion\n\
+                       moves by more than TOL between checkpoints (default: off)\n\
+         --converge-every N  reads between convergence checkpoints (default: 100000)\n\
+         -e    emit reads to stdout, for pipelining (default: off)\n\
+         --overrep F  report read starts (first 50 bases) making up more than a\n\
+                       fraction F of reads, e.g. 0.001 (default: off)\n\
+         --timeline N  summarize each window of N reads by position, to\n\
+                       <prefix>_timeline.txt (default: off)\n\
+         --complexity  profile trailing homopolymers (poly-G tails) and DUST\n\
+                       low-complexity scores (default: off)\n\
+         --insert  estimate insert sizes from the overlap of mates; with -i (default: off)\n\
+         --demux FILE  statistics per sample of a pooled run; FILE has a sample name\n\
+                       and index per line (default: off)\n\
+         --demux-offset N  read the index at 0-based offset N of the read rather\n\
+                       than from the Casava comment (default: comment)\n\
+         --checkpoint FILE  save the statistics to FILE periodically (default: off)\n\
+         --checkpoint-every SEC  seconds between checkpoints (default: 600)\n\
+         --resume  continue from the --checkpoint file, if there is one (default: off)\n\
+         --live FILE  publish running counters to FILE, e.g. /dev/shm/seqqs, for\n\
+                      'seqqs peek' (default: off)\n\
+         -f    input is FASTA (no quality lines, default: off)\n\
+         -i    input is interleaved, output statistics per each file (default: off)\n\
+         -s    strict; some warnings become errors (default: off)\n\
+         -L    long reads; bin positions and lengths (default: off)\n\
+         -v    verbose; report peak memory when done (default: off)\n\
+         --format FMT  output format, one of tsv, json, or bin (default: tsv)\n\
+Arguments:  <in.fq> or '-' for stdin; FASTA/Q, optionally gzip or zstd\n\
+	    compressed, or unaligned BAM.\n\n", stderr);
+  fputs("\
+Output:\n\
+<prefix> is output prefix name. The following output files will be created:\n\
+<prefix>_qual.txt:  quality distribution by position matrix\n\
+<prefix>_nucl.txt:  nucleotide distribution by position matrix\n\
+<prefix>_len.txt:   length distribution by position matrix\n\
+<prefix>_summary.txt:  number of reads and bases seen, reads used for statistics,\n\
+                       and the read at which they converged (with --converge)\n\
+<prefix>_kmer_enrich.txt:  most enriched k-mers by position, observed vs expected\n\
+<prefix>_kmer.txt:  k-mer distribution by position matrix (with --kmer-all); with\n\
+                    --kmer-mem, the most frequent k-mers and a lower bound on\n\
+                    each count\n\
+<prefix>_spectrum.txt:  number of distinct K-mers by multiplicity (with --spectrum)\n\
+<prefix>_overrep.txt:  overrepresented sequences, with the bounds on each count\n\
+                       (with --overrep)\n\
+<prefix>_timeline.txt:  mean quality, N rate, and GC by position for each window\n\
+                        of reads (with --timeline)\n\
+<prefix>_complexity.txt:  reads by trailing run length and base, poly-G tails by\n\
+                          starting position, and reads by DUST score (with\n\
+                          --complexity)\n\
+<prefix>_insert.txt:  read pairs by insert size, from mate overlaps (with --insert)\n\
+<prefix>_demux.txt:  reads per sample, and how many matched with one mismatch\n\
+                     (with --demux; each sample's files are <prefix><sample>_*)\n\
+\
+If -i is used, these will have \"_1.txt\" and \"_2.txt\" suffixes.\n\
+With --format json, all of the above is written to <prefix>_stats.json, and\n\
+with --format bin to the columnar little-endian <prefix>_stats.bin.\n", stderr);
+  return 1;
+}
+
+typedef enum {
+  FMT_TSV,
+  FMT_JSON,
+  FMT_BIN
+} out_format;
+
+enum {
+  OPT_FORMAT = 256,
+  OPT_KMER_TOP,
+  OPT_KMER_ALL,
+  OPT_KMER_MEM,
+  OPT_KMER_SPILL,
+  OPT_SPECTRUM,
+  OPT_SAMPLE_FRAC,
+  OPT_SAMPLE_N,
+  OPT_CONVERGE,
+  OPT_CONVERGE_EVERY,
+  OPT_LIVE,
+  OPT_CHECKPOINT,
+  OPT_CHECKPOINT_EVERY,
+  OPT_RESUME,
+  OPT_DEMUX,
+  OPT_DEMUX_OFFSET,
+  OPT_INSERT,
+  OPT_OVERREP,
+  OPT_TIMELINE,
+  OPT_COMPLEXITY
+};
+
+static struct option long_options[] = {
+  {"format", required_argument, NULL, OPT_FORMAT},
+  {"kmer-top", required_argument, NULL, OPT_KMER_TOP},
+  {"kmer-all", no_argument, NULL, OPT_KMER_ALL},
+  {"kmer-mem", required_argument, NULL, OPT_KMER_MEM},
+  {"kmer-spill", required_argument, NULL, OPT_KMER_SPILL},
+  {"spectrum", required_argument, NULL, OPT_SPECTRUM},
+  {"sample-frac", required_argument, NULL, OPT_SAMPLE_FRAC},
+  {"sample-n", required_argument, NULL, OPT_SAMPLE_N},
+  {"converge", required_argument, NULL, OPT_CONVERGE},
+  {"converge-every", required_argument, NULL, OPT_CONVERGE_EVERY},
+  {"live", required_argument, NULL, OPT_LIVE},
+  {"checkpoint", required_argument, NULL, OPT_CHECKPOINT},
+  {"checkpoint-every", required_argument, NULL, OPT_CHECKPOINT_EVERY},
+  {"resume", no_argument, NULL, OPT_RESUME},
+  {"demux", required_argument, NULL, OPT_DEMUX},
+  {"demux-offset", required_argument, NULL, OPT_DEMUX_OFFSET},
+  {"insert", no_argument, NULL, OPT_INSERT},
+  {"overrep", required_argument, NULL, OPT_OVERREP},
+  {"timeline", required_argument, NULL, OPT_TIMELINE},
+  {"complexity", no_argument, NULL, OPT_COMPLEXITY},
+  {NULL, 0, NULL, 0}
+};
+
+/* records between looking at the clock, and seconds between snapshots */
+#define CLOCK_EVERY 4096
+#define LIVE_INTERVAL 1.0
+
+static double now_sec(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+/* 
+   Publish the counters if a snapshot is due, or unconditionally once
+   done. st keeps the previous snapshot, for the rate.
+*/
+static void qs_live_update(live_t *lv, live_stats_t *st, qs_set_t **qs, int n_sets,
+			   const uio_in_t *fp, double t0, int done) {
+  double t = now_sec() - t0;
+  int i;
+  if (!done && t - st->elapsed < LIVE_INTERVAL) return;
+  if (done)
+    st->reads_per_sec = t > 0 ? qs[0]->n_reads/t : 0;
+  else
+    st->reads_per_sec = (qs[0]->n_reads - st->sets[0].reads)/(t - st->elapsed);
+  st->done = done;
+  st->elapsed = t;
+  st->n_sets = n_sets;
+  st->bytes_in = fp->r->n_in;
+  for (i = 0; i < n_sets; i++) {
+    st->sets[i].reads = qs[i]->n_reads;
+    st->sets[i].sampled = qs[i]->n_sampled;
+    st->sets[i].bases = qs[i]->n_bases;
+    st->sets[i].rows = qs[i]->l;
+    st->sets[i].converged_at = qs[i]->converged_at;
+  }
+  live_publish(lv, st);
+}
+
+/* 
+   Timeline windows: every N reads, what the matrices gained since the
+   previous window is summarized per position. Like the convergence
+   checkpoints, windows are differences of the running counts, so reads
+   cost nothing extra and only the totals at the last window are kept;
+   each window is written out as it closes.
+*/
+enum { TL_BASES, TL_QSUM, TL_QN, TL_N, TL_GC, TL_ACGT, TL_NCOL };
+
+static void qs_timeline_header(FILE *file, int binned, int paired) {
+  fprintf(file, "window\tfirst_read\t%s%s\tbases\tmean_qual\tn_rate\tgc\n",
+	  paired ? "mate\t" : "", binned ? "start\tend" : "pos");
+}
+
+static void qs_timeline_fprint(FILE *file, qs_set_t *qs, uint64_t window, uint64_t first, int mate) {
+  kstring_t out = {0, 0, 0};
+  unsigned i, j, nq = has_qual(qs) ? qrng(qs->qt) : 0;
+  int64_t v[TL_NCOL], *prev;
+
+  if (qs->tl_l < qs->l) {
+    qs->tl = realloc(qs->tl, qs->l*TL_NCOL*sizeof(int64_t));
+    memset(qs->tl + qs->tl_l*TL_NCOL, 0, (qs->l - qs->tl_l)*TL_NCOL*sizeof(int64_t));
+    qs->tl_l = qs->l;
+  }
+  for (i = 0; i < qs->l; i++) {
+    memset(v, 0, sizeof(v));
+    for (j = 0; j < 17; j++) v[TL_BASES] += qs->ntm[i][j];
+    v[TL_N] = qs->ntm[i][15];
+    v[TL_GC] = qs->ntm[i][2] + qs->ntm[i][4];
+    v[TL_ACGT] = v[TL_GC] + qs->ntm[i][1] + qs->ntm[i][8];
+    for (j = 0; j < nq; j++) {
+      v[TL_QN] += qs->qm[i][j];
+      v[TL_QSUM] += ((int64_t) j + qmin(qs->qt))*(int64_t) qs->qm[i][j];
+    }
+    prev = qs->tl + i*TL_NCOL;
+    for (j = 0; j < TL_NCOL; j++) {
+      v[j] -= prev[j];
+      prev[j] += v[j];
+    }
+    if (!v[TL_BASES]) continue;
+
+    kputu64(window, &out);
+    kputc('\t', &out);
+    kputu64(first, &out);
+    kputc('\t', &out);
+    if (mate) {
+      kputint(mate, &out);
+      kputc('\t', &out);
+    }
+    if (qs->binned) {
+      qs_pos_label(&out, i);
+    } else {
+      kputu64(i+1, &out);
+      kputc('\t', &out);
+    }
+    kputu64(v[TL_BASES], &out);
+    kputc('\t', &out);
+    if (v[TL_QN]) kputf((double) v[TL_QSUM]/v[TL_QN], &out);
+    else kputs("NA", &out);
+    kputc('\t', &out);
+    kputf((double) v[TL_N]/v[TL_BASES], &out);
+    kputc('\t', &out);
+    if (v[TL_ACGT]) kputf((double) v[TL_GC]/v[TL_ACGT], &out);
+    else kputs("NA", &out);
+    kputc('\n', &out);
+    kflush(&out, file, 0);
+  }
+  kflush(&out, file, 1);
+  free(out.s);
+}
+
+static int peek_usage() {
+  fputs("\
+Usage: seqqs peek [options] <live file>\n\n\
+Prints the counters a running 'seqqs --live <live file>' last published.\n\n\
+Options: -w SEC  print again every SEC seconds until the run is done (default: once)\n", stderr);
+  return 1;
+}
+
+static int peek_main(int argc, char *argv[]) {
+  int c;
+  double every = 0;
+  live_stats_t st;
+  while ((c = getopt(argc, argv, "w:")) >= 0) {
+    switch (c) {
+    case 'w':
+      every = atof(optarg);
+      if (every <= 0) {
+	fprintf(stderr, "Invalid interval '%s'.\n", optarg);
+	return 1;
+      }
+      break;
+    default:
+      return peek_usage();
+    }
+  }
+  if (optind == argc) return peek_usage();
+  for (;;) {
+    if (live_peek(argv[optind], &st)) return 1;
+    live_fprint(stdout, &st);
+    if (!every || st.done) break;
+    putchar('\n');
+    fflush(stdout);
+    usleep((useconds_t) (every*1e6));
+  }
+  return 0;
+}
+
+#define CKPT_MAGIC "SQCK"
+#define CKPT_VERSION 2
+
+/* 
+   Checkpoint header: the options that shape the statistics, which a
+   resumed run must share, and how far the input had been processed.
+*/
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  int32_t qt, k, binned, n_sets;
+  double sample_frac, converge_tol;
+  uint64_t converge_every;
+  uint64_t n_rec, rng; /* records (or pairs) done, and sampling state */
+  uint64_t offset; /* uncompressed input offset of the next record */
+  uint64_t voffset; /* and its BGZF virtual offset, or UIO_NO_VOFF */
+} ckpt_hdr_t;
+
+/* where the next record starts; kseq reads ahead, and has already taken the '>' of a FASTA record */
+static uint64_t input_offset(const uio_in_t *fp, const kseq_t *seq) {
+  const kstream_t *ks = seq->f;
+  return fp->n_out - (ks->begin < ks->end ? ks->end - ks->begin : 0) - (seq->last_char ? 1 : 0);
+}
+
+/* written to a temporary file and renamed over the last one, so a checkpoint is never half-written */
+static int checkpoint_save(const char *fn, const ckpt_hdr_t *hdr, qs_set_t **qs) {
+  kstring_t tmp = {0, 0, 0};
+  FILE *fp;
+  int i, err = 1;
+
+  kputs(fn, &tmp);
+  kputs(".tmp", &tmp);
+  if ((fp = fopen(tmp.s, "wb"))) {
+    err = ck_write(fp, hdr, sizeof(ckpt_hdr_t));
+    for (i = 0; i < hdr->n_sets; i++) err |= qs_checkpoint_write(fp, qs[i]);
+    err |= fflush(fp) != 0;
+    err |= fsync(fileno(fp)) != 0;
+    err |= fclose(fp) != 0;
+    if (!err) err = rename(tmp.s, fn) != 0;
+  }
+  if (err) {
+    fprintf(stderr, "[%s] warning: cannot write checkpoint '%s': %s\n", __func__, fn, strerror(errno));
+    unlink(tmp.s);
+  }
+  free(tmp.s);
+  return err;
+}
+
+/* 
+   Restore the sets from a checkpoint taken with the same options as
+   hdr, filling in how far it got. Returns 1 if there is none.
+*/
+static int checkpoint_load(const char *fn, ckpt_hdr_t *hdr, qs_set_t **qs) {
+  ckpt_hdr_t ck;
+  FILE *fp = fopen(fn, "rb");
+  int i;
+
+  if (!fp) return 1;
+  if (ck_read(fp, &ck, sizeof(ck)) || memcmp(ck.magic, CKPT_MAGIC, 4) || ck.version != CKPT_VERSION) {
+    fprintf(stderr, "[%s] error: '%s' is not a seqqs checkpoint.\n", __func__, fn);
+    exit(1);
+  }
+  if (ck.qt != hdr->qt || ck.k != hdr->k || ck.binned != hdr->binned || ck.n_sets != hdr->n_sets
+      || ck.sample_frac != hdr->sample_frac || ck.converge_tol != hdr->converge_tol
+      || ck.converge_every != hdr->converge_every) {
+    fprintf(stderr, "[%s] error: checkpoint '%s' was taken with different options.\n", __func__, fn);
+    exit(1);
+  }
+  for (i = 0; i < ck.n_sets; i++) {
+    if (qs_checkpoint_read(fp, qs[i])) {
+      fprintf(stderr, "[%s] error: checkpoint '%s' is truncated or corrupt.\n", __func__, fn);
+      exit(1);
+    }
+  }
+  fclose(fp);
+  *hdr = ck;
+  return 0;
+}
+
+/* 
+   Move the input to a checkpoint's offset. With -e, the skipped input
+   is passed through unchanged, so downstream still sees every read.
+*/
+static int input_skip(uio_in_t *fp, uint64_t off, uint64_t voff, emitter_t *em) {
+  char buf[65536];
+  int n;
+  if (!em && uio_seek(fp, off, voff) == 0) return 0;
+  while (fp->n_out < off) {
+    n = uio_read(fp, buf, off - fp->n_out < sizeof(buf) ? off - fp->n_out : sizeof(buf));
+    if (n <= 0) return -1;
+    if (em) emit_write(em, buf, n);
+  }
+  return 0;
+}
+
+/* sizes like 512M or 2G; 0 on error */
+static size_t parse_size(const char *s) {
+  char *end;
+  double x = strtod(s, &end);
+  if (end == s || x <= 0) return 0;
+  switch (toupper(*end)) {
+  case 'G': x *= 1024;
+  case 'M': x *= 1024;
+  case 'K': x *= 1024; end++;
+  case '\0': break;
+  default: return 0;
+  }
+  return *end ? 0 : (size_t) x;
+}
+
+/* xorshift64*; fast, and plenty for picking reads */
+static inline uint64_t xorshift64(uint64_t *state) {
+  uint64_t x = *state;
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  *state = x;
+  return x * 0x2545f4914f6cdd1dULL;
+}
+
+/* uniform in [0, 1) */
+static inline double xorshift_unit(uint64_t *state) {
+  return (xorshift64(state) >> 11) * (1.0/9007199254740992.0);
+}
+
+/* 
+   Reservoir sampling: the slot record number n (0-indexed) replaces,
+   or -1 if it is not kept. Every record ends up in the reservoir with
+   the same probability.
+*/
+static int64_t reservoir_slot(uint64_t *state, uint64_t n, uint64_t size) {
+  uint64_t j;
+  if (n < size) return n;
+  j = xorshift64(state) % (n + 1);
+  return j < size ? (int64_t) j : -1;
+}
+
+static void kseq_copy(kseq_t *dst, const kseq_t *src) {
+  dst->name.l = dst->comment.l = dst->seq.l = dst->qual.l = 0;
+  kputsn(src->name.s, src->name.l, &dst->name);
+  kputsn(src->seq.s, src->seq.l, &dst->seq);
+  if (src->qual.l) kputsn(src->qual.s, src->qual.l, &dst->qual);
+}
+
+/* 
+   Pass one record to the statistics, unless sampling leaves it out;
+   with a reservoir, keep a copy for later instead.
+*/
+static void qs_sample(qs_set_t *qs, qs_update_f update, kseq_t *seq, int use, kseq_t *slot, int strict) {
+  if (use) {
+    update(qs, seq, strict);
+    return;
+  }
+  qs_skip(qs, seq);
+  if (slot) kseq_copy(slot, seq);
+}
+
+/* 
+   qs_printseq() through the emit ring, with unwrapped lines. -e output
+   goes through a writer thread so that a slow consumer downstream
+   does not stall the statistics.
+*/
+#define EMIT_SLOTS 16
+#define EMIT_BATCH (1<<20)
+
+static void qs_emitseq(emitter_t *e, const kseq_t *s) {
+  emit_putc(e, s->qual.l ? '@' : '>');
+  emit_write(e, s->name.s, s->name.l);
+  if (s->comment.l) {
+    emit_putc(e, ' ');
+    emit_write(e, s->comment.s, s->comment.l);
+  }
+  if (s->seq.l) {
+    emit_putc(e, '\n');
+    emit_write(e, s->seq.s, s->seq.l);
+  }
+  emit_putc(e, '\n');
+  if (s->qual.l) {
+    emit_write(e, "+\n", 2);
+    emit_write(e, s->qual.s, s->qual.l);
+    emit_putc(e, '\n');
+  }
+}
+
+/* the next record, from FASTA/Q text or decoded from BAM into the same strings */
+static inline int read_record(kseq_t *seq, bam_t *bam, unsigned *flag) {
+  return bam ? bam_read(bam, &seq->name, &seq->seq, &seq->qual, flag) : kseq_read(seq);
+}
+
+static FILE *open_output(const char *prefix, const char *name, const char *suffix) {
+  FILE *fp;
+  char *fn = calloc(strlen(prefix) + strlen(name) + strlen(suffix) + 1, sizeof(char));
+  sprintf(fn, "%s%s%s", prefix, name, suffix);
+  fp = fopen(fn, "w");
+  check_fopen(fp);
+  free(fn);
+  return fp;
+}
+
+/* the statistics files of a run, or of one sample with --demux */
+typedef struct {
+  FILE *qual[2], *nucl[2], *len[2], *summary[2], *enrich[2], *kmer[2], *over[2], *cx[2], *stats;
+} qs_outputs_t;
+
+static void outputs_open(qs_outputs_t *o, const char *prefix, int n_sets, qual_type qt, unsigned k,
+			 int overrep, int complexity, const qs_outopt_t *opt, out_format format) {
+  char suffix[8];
+  int pr;
+  /* text in every format, like the spectrum and the timeline */
+  for (pr = 0; complexity && pr < n_sets; pr++) {
+    sprintf(suffix, n_sets > 1 ? "_%d.txt" : ".txt", pr+1);
+    o->cx[pr] = open_output(prefix, "complexity", suffix);
+  }
+  if (format == FMT_JSON) {
+    o->stats = open_output(prefix, "stats", ".json");
+  } else if (format == FMT_BIN) {
+    o->stats = open_output(prefix, "stats", ".bin");
+  } else {
+    for (pr = 0; pr < n_sets; pr++) {
+      if (n_sets > 1)
+	sprintf(suffix, "_%d.txt", pr+1);
+      else
+	sprintf(suffix, ".txt");
+
+      if (qt != NONE)
+	o->qual[pr] = open_output(prefix, "qual", suffix);
+      o->nucl[pr] = open_output(prefix, "nucl", suffix);
+      o->len[pr] = open_output(prefix, "len", suffix);
+      o->summary[pr] = open_output(prefix, "summary", suffix);
+      if (k)
+	o->enrich[pr] = open_output(prefix, "kmer_enrich", suffix);
+      if (k && opt->kmer_dump)
+	o->kmer[pr] = open_output(prefix, "kmer", suffix);
+      if (overrep)
+	o->over[pr] = open_output(prefix, "overrep", suffix);
+    }
+  }
+}
+
+/* write the statistics and close the files */
+static void outputs_write(qs_outputs_t *o, qs_set_t **qs, int n_sets, const qs_outopt_t *opt, out_format format) {
+  int pr;
+  for (pr = 0; pr < n_sets; pr++) {
+    if (!qs[pr]->cx) continue;
+    qs_complexity_fprint(o->cx[pr], qs[pr]);
+    fclose(o->cx[pr]);
+  }
+  if (format == FMT_JSON) {
+    qs_json_fprint(o->stats, qs, n_sets, opt);
+    fclose(o->stats);
+  } else if (format == FMT_BIN) {
+    qs_bin_fprint(o->stats, qs, n_sets, opt);
+    fclose(o->stats);
+  } else {
+    for (pr = 0; pr < n_sets; pr++) {
+      qs_ntm_fprint(o->nucl[pr], qs[pr]);
+      if (has_qual(qs[pr]))
+	qs_qm_fprint(o->qual[pr], qs[pr]);
+      qs_lm_fprint(o->len[pr], qs[pr]);
+      qs_summary_fprint(o->summary[pr], qs[pr]);
+      if (qs[pr]->k) qs_enrich_fprint(o->enrich[pr], qs[pr], opt->kmer_top);
+      if (qs[pr]->k && opt->kmer_dump) qs_kmer_fprint(o->kmer[pr], qs[pr]);
+      if (qs[pr]->over) qs_overrep_fprint(o->over[pr], qs[pr]);
+      if (has_qual(qs[pr]))
+	fclose(o->qual[pr]);
+      fclose(o->nucl[pr]); fclose(o->len[pr]); fclose(o->summary[pr]);
+      if (qs[pr]->k) fclose(o->enrich[pr]);
+      if (qs[pr]->k && opt->kmer_dump) fclose(o->kmer[pr]);
+      if (qs[pr]->over) fclose(o->over[pr]);
+    }
+  }
+}
+
+/* how every statistics set of a run is set up */
+typedef struct {
+  qual_type qt;
+  unsigned k;
+  int binned;
+  size_t kmer_mem, spill_mem; /* per set */
+  double converge_tol, over_frac;
+  int complexity;
+  uint64_t converge_every;
+  spectrum_t *spec;
+} qs_conf_t;
+
+static qs_set_t *qs_new(const qs_conf_t *cf) {
+  qs_set_t *qs = qs_init(cf->qt, cf->k, cf->binned);
+  qs->spec = cf->spec;
+  if (cf->kmer_mem) qs_use_sketch(qs, cf->kmer_mem);
+  else if (cf->spill_mem) qs_use_spill(qs, cf->spill_mem);
+  if (cf->converge_tol) qs_use_converge(qs, cf->converge_tol, cf->converge_every);
+  if (cf->over_frac) qs_use_overrep(qs, cf->over_frac);
+  if (cf->complexity) qs_use_complexity(qs);
+  return qs;
+}
+
+int main(int argc, char *argv[]) {
+  int c, pr=0, k=0, emit=0, strict=0, interleaved=0, binned=0;
+  int has_prefix=0, spec_k=0, n_threads=1, use=1, resume=0;
+  int n_groups=1, g, do_insert=0, complexity=0, verbose=0;
+  unsigned flag=0, flag1=0, warned_pairs=0;
+  char *prefix="", *live_fn=NULL, *ck_fn=NULL, *demux_fn=NULL, *end;
+  long demux_off=-1, top;
+  kstring_t rname = {0, 0, 0}, rcomment = {0, 0, 0}, rseq = {0, 0, 0}, gprefix = {0, 0, 0};
+  FILE *spec_fp=NULL, *demux_fp, *insert_fp=NULL, *tl_fp=NULL;
+  insert_t *ins=NULL;
+  qs_outputs_t out;
+  qs_conf_t cf;
+  demux_t *dm=NULL;
+  qual_type qtype=SANGER;
+  out_format format=FMT_TSV;
+  qs_outopt_t opt = {100, 0};
+  size_t arena_bytes = 0, kmer_mem = 0, spill_mem = 0;
+  double sample_frac = 1, converge_tol = 0, over_frac = 0;
+  uint64_t converge_every = 100000, tl_every = 0, sample_n = 0, n_rec = 0, n_res, i, n_reads, n_bases, rng = 0x9e3779b97f4a7c15ULL;
+  int64_t slot = -1;
+  kseq_t **res = NULL;
+  struct rusage ru;
+  qs_set_t **qs, **pool, **set;
+  qs_update_f update[2];
+  spectrum_t *spec=NULL;
+  emitter_t *em=NULL;
+  live_t *lv=NULL;
+  bam_t *bam=NULL;
+  live_stats_t lst;
+  struct stat sb;
+  double t0 = now_sec(), ck_every = 600, ck_last = t0;
+  ckpt_hdr_t ck;
+  uio_in_t *fp;
+  kseq_t *seq;
+
+  if (argc == 1) return usage();
+  if (strcmp(argv[1], "peek") == 0) return peek_main(argc-1, argv+1);
+
+  while ((c = getopt_long(argc, argv, "q:k:p:t:efsiLv", long_options, NULL)) >= 0) {
+    switch (c) {
+    case 'q':
+      if (strcmp(optarg, "illumina") == 0)
+	qtype = ILLUMINA;
+      else if (strcmp(optarg, "solexa") == 0)
+	qtype = SOLEXA;
+      else if (strcmp(optarg, "sanger") == 0)
+	qtype = SANGER;
+      else {
+	fprintf(stderr, "Unknown quality type '%s'.\n", optarg);
+	return(1);
+      }
+      break;
+    case 'f':
+      qtype = NONE;
+      break;
+    case 'k':
+      k = atoi(optarg);
+      break;
+    case 's':
+      strict = 1;
+      break;
+    case 'i':
+      interleaved = 1;
+      break;
+    case 'L':
+      binned = 1;
+      break;
+    case 'v':
+      verbose = 1;
+      break;
+    case 't':
+      n_threads = atoi(optarg);
+      if (n_threads < 1) {
+	fprintf(stderr, "Invalid number of threads '%s'.\n", optarg);
+	return(1);
+      }
+      break;
+    case 'e':
+      emit = 1;
+      break;
+    case 'p':
+      prefix = calloc(strlen(optarg)+2, sizeof(char));
+      sprintf(prefix, "%s_", optarg);
+      has_prefix = 1;
+      break;
+    case OPT_KMER_TOP:
+      top = strtol(optarg, &end, 10);
+      if (end == optarg || *end || top < 1 || top > INT_MAX) {
+	fprintf(stderr, "[%s] error: --kmer-top needs a positive integer, not '%s'.\n", __func__, optarg);
+	return 1;
+      }
+      opt.kmer_top = (unsigned) top;
+      break;
+    case OPT_KMER_ALL:
+      opt.kmer_dump = 1;
+      break;
+    case OPT_KMER_MEM:
+      kmer_mem = parse_size(optarg);
+      if (!kmer_mem) {
+	fprintf(stderr, "Invalid k-mer memory size '%s'.\n", optarg);
+	return(1);
+      }
+      break;
+    case OPT_KMER_SPILL:
+      spill_mem = parse_size(optarg);
+      if (!spill_mem) {
+	fprintf(stderr, "Invalid k-mer spill size '%s'.\n", optarg);
+	return(1);
+      }
+      break;
+    case OPT_SPECTRUM:
+      spec_k = atoi(optarg);
+      if (spec_k < 1 || spec_k > SPECTRUM_MAX_K) {
+	fprintf(stderr, "Invalid spectrum k-mer length '%s'.\n", optarg);
+	return(1);
+      }
+      break;
+    case OPT_SAMPLE_FRAC:
+      sample_frac = atof(optarg);
+      if (sample_frac <= 0 || sample_frac > 1) {
+	fprintf(stderr, "Invalid sample fraction '%s'.\n", optarg);
+	return(1);
+      }
+      break;
+    case OPT_SAMPLE_N:
+      sample_n = strtoull(optarg, NULL, 10);
+      if (!sample_n) {
+	fprintf(stderr, "Invalid sample size '%s'.\n", optarg);
+	return(1);
+      }
+      break;
+    case OPT_CONVERGE:
+      converge_tol = atof(optarg);
+      if (converge_tol <= 0) {
+	fprintf(stderr, "Invalid convergence tolerance '%s'.\n", optarg);
+	return(1);
+      }
+      break;
+    case OPT_CONVERGE_EVERY:
+      converge_every = strtoull(optarg, NULL, 10);
+      if (!converge_every) {
+	fprintf(stderr, "Invalid convergence checkpoint interval '%s'.\n", optarg);
+	return(1);
+      }
+      break;
+    case OPT_TIMELINE:
+      tl_every = strtoull(optarg, NULL, 10);
+      if (!tl_every) {
+	fprintf(stderr, "Invalid timeline window '%s'.\n", optarg);
+	return(1);
+      }
+      break;
+    case OPT_LIVE:
+      live_fn = optarg;
+      break;
+    case OPT_CHECKPOINT:
+      ck_fn = optarg;
+      break;
+    case OPT_CHECKPOINT_EVERY:
+      ck_every = atof(optarg);
+      if (ck_every <= 0) {
+	fprintf(stderr, "Invalid checkpoint interval '%s'.\n", optarg);
+	return(1);
+      }
+      break;
+    case OPT_RESUME:
+      resume = 1;
+      break;
+    case OPT_OVERREP:
+      over_frac = atof(optarg);
+      if (over_frac <= 0 || over_frac >= 1) {
+	fprintf(stderr, "Invalid overrepresentation fraction '%s'.\n", optarg);
+	return(1);
+      }
+      break;
+    case OPT_COMPLEXITY:
+      complexity = 1;
+      break;
+    case OPT_INSERT:
+      do_insert = 1;
+      break;
+    case OPT_DEMUX:
+      demux_fn = optarg;
+      break;
+    case OPT_DEMUX_OFFSET:
+      demux_off = atol(optarg);
+      if (demux_off < 0) {
+	fprintf(stderr, "Invalid index offset '%s'.\n", optarg);
+	return(1);
+      }
+      break;
+    case OPT_FORMAT:
+      if (strcmp(optarg, "tsv") == 0)
+	format = FMT_TSV;
+      else if (strcmp(optarg, "json") == 0)
+	format = FMT_JSON;
+      else if (strcmp(optarg, "bin") == 0)
+	format = FMT_BIN;
+      else {
+	fprintf(stderr, "Unknown output format '%s'.\n", optarg);
+	return(1);
+      }
+      break;
+    case 'h':
+    default:
+      return usage();
+    }
+  }
+
+  if (argc == optind) return usage();
+  if (resume && !ck_fn) {
+    fprintf(stderr, "[%s] error: --resume needs --checkpoint.\n", __func__);
+    return 1;
+  }
+  if (ck_fn && (sample_n || kmer_mem || spill_mem || spec_k || over_frac || complexity)) {
+    fprintf(stderr, "[%s] error: --checkpoint cannot be used with --sample-n, --kmer-mem, --kmer-spill, --spectrum, --overrep, or --complexity.\n", __func__);
+    return 1;
+  }
+  if (demux_fn && (sample_n || ck_fn || live_fn)) {
+    fprintf(stderr, "[%s] error: --demux cannot be used with --sample-n, --checkpoint, or --live.\n", __func__);
+    return 1;
+  }
+  if (tl_every && (sample_n || converge_tol || demux_fn || ck_fn)) {
+    fprintf(stderr, "[%s] error: --timeline cannot be used with --sample-n, --converge, --demux, or --checkpoint.\n", __func__);
+    return 1;
+  }
+  if (do_insert && !interleaved) {
+    fprintf(stderr, "[%s] error: --insert needs interleaved pairs (-i).\n", __func__);
+    return 1;
+  }
+  if (demux_off >= 0 && !demux_fn) {
+    fprintf(stderr, "[%s] error: --demux-offset needs --demux.\n", __func__);
+    return 1;
+  }
+  fp = uio_open(argv[optind], n_threads);
+  if (!fp) {
+    fprintf(stderr, "[%s] error: cannot open '%s'.\n", __func__, argv[optind]);
+    return 1;
+  }
+  if (bam_sniff(fp)) {
+    /* checkpoint offsets are into uncompressed text */
+    if (ck_fn) {
+      fprintf(stderr, "[%s] error: --checkpoint cannot be used with BAM input.\n", __func__);
+      return 1;
+    }
+    /* raw qualities are still written out for -e as Sanger when -f ignores them */
+    bam = bam_open(fp, qoffset(qtype == NONE ? SANGER : qtype));
+    if (!bam) return 1;
+  }
+  if (demux_fn) {
+    dm = demux_init(demux_fn);
+    if (demux_off >= 0) demux_use_read(dm, demux_off);
+    n_groups = dm->n + 1;
+  }
+
+  /* with --demux, each sample's files are opened once it is done */
+  if (!dm) outputs_open(&out, prefix, interleaved+1, qtype, k, over_frac > 0, complexity, &opt, format);
+  if (spec_k) {
+    spec_fp = open_output(prefix, "spectrum", ".txt");
+    spec = spectrum_init(spec_k, n_threads);
+  }
+  if (tl_every) {
+    tl_fp = open_output(prefix, "timeline", ".txt");
+    qs_timeline_header(tl_fp, binned, interleaved);
+  }
+  if (do_insert) {
+    insert_fp = open_output(prefix, "insert", ".txt");
+    ins = insert_init();
+  }
+
+  /* the budget is split between the statistics sets */
+  cf.qt = qtype; cf.k = k; cf.binned = binned; cf.spec = spec;
+  cf.kmer_mem = kmer_mem/(n_groups*(interleaved+1));
+  cf.spill_mem = spill_mem/(n_groups*(interleaved+1));
+  cf.converge_tol = converge_tol; cf.converge_every = converge_every;
+  cf.over_frac = over_frac;
+  cf.complexity = complexity;
+
+  /* 
+     One group of sets (both mates with -i) per sample, created on its
+     first read. The last group is for reads of no sample, and is the
+     only one without --demux.
+  */
+  pool = calloc(n_groups*(interleaved+1), sizeof(qs_set_t*));
+  qs = pool + (n_groups-1)*(interleaved+1);
+  for (pr = 0; pr < interleaved+1; pr++) {
+    qs[pr] = qs_new(&cf);
+    update[pr] = qs_update_kernel(qs[pr], strict);
+  }
+  seq = kseq_init(fp);
+  if (ck_fn) {
+    memset(&ck, 0, sizeof(ck));
+    memcpy(ck.magic, CKPT_MAGIC, 4);
+    ck.version = CKPT_VERSION;
+    ck.qt = qtype; ck.k = k; ck.binned = binned; ck.n_sets = interleaved+1;
+    ck.sample_frac = sample_frac; ck.converge_tol = converge_tol; ck.converge_every = converge_every;
+  }
+  if (live_fn) {
+    lv = live_open(live_fn);
+    if (!lv) return 1;
+    memset(&lst, 0, sizeof(lst));
+    if (fstat(fp->r->fd, &sb) == 0 && S_ISREG(sb.st_mode)) lst.size_in = sb.st_size;
+    lst.n_sets = interleaved+1;
+    live_publish(lv, &lst);
+  }
+  if (emit) em = emit_init(fileno(stdout), EMIT_SLOTS, EMIT_BATCH);
+  if (resume) {
+    if (checkpoint_load(ck_fn, &ck, qs)) {
+      fprintf(stderr, "[%s] no checkpoint '%s' yet; starting from the beginning\n", __func__, ck_fn);
+    } else {
+      if (input_skip(fp, ck.offset, ck.voffset, em)) {
+	fprintf(stderr, "[%s] error: input ends before the checkpoint offset; is it the same input?\n", __func__);
+	return 1;
+      }
+      n_rec = ck.n_rec;
+      rng = ck.rng;
+      fprintf(stderr, "[%s] resuming after %llu records\n", __func__, (long long unsigned int) n_rec);
+    }
+  }
+  if (sample_n) {
+    /* a reservoir slot holds a record, or both mates of a pair */
+    res = malloc(sample_n*(interleaved+1)*sizeof(kseq_t*));
+    for (i = 0; i < sample_n*(interleaved+1); i++)
+      res[i] = calloc(1, sizeof(kseq_t));
+  }
+
+  while (read_record(seq, bam, &flag) >= 0) {
+    /* pairs are sampled together */
+    if (sample_n) {
+      slot = reservoir_slot(&rng, n_rec, sample_n);
+      use = 0;
+    } else if (sample_frac < 1) {
+      use = xorshift_unit(&rng) < sample_frac;
+    }
+    n_rec++;
+    if (bam && !interleaved && (flag & BAM_FPAIRED) && !warned_pairs++)
+      fprintf(stderr, "[%s] warning: BAM records are paired; use -i for statistics per mate\n", __func__);
+    if (lv && n_rec % CLOCK_EVERY == 0) qs_live_update(lv, &lst, qs, interleaved+1, fp, t0, 0);
+
+    /* mates go to the sample of the first read's index */
+    set = qs;
+    if (dm && (g = demux_assign(dm, seq->seq.s, seq->seq.l, seq->comment.s, seq->comment.l)) >= 0) {
+      set = pool + g*(interleaved+1);
+      if (!set[0])
+	for (pr = 0; pr < interleaved+1; pr++) set[pr] = qs_new(&cf);
+    }
+
+    qs_sample(set[0], update[0], seq, use, slot >= 0 ? res[slot*(interleaved+1)] : NULL, strict);
+    if (em) qs_emitseq(em, seq);
+
+    /* for interleaved files, grab and process another entry */
+    if (interleaved) {
+      flag1 = flag;
+      rname.l = 0;
+      kputsn(seq->name.s, seq->name.l, &rname);
+      rcomment.l = 0;
+      kputsn(seq->comment.s ? seq->comment.s : "", seq->comment.l, &rcomment);
+      if (ins) {
+	rseq.l = 0;
+	kputsn(seq->seq.s, seq->seq.l, &rseq);
+      }
+      if (read_record(seq, bam, &flag) >= 0) {
+	qs_sample(set[1], update[1], seq, use, slot >= 0 ? res[slot*(interleaved+1) + 1] : NULL, strict);
+	if (ins) insert_add(ins, rseq.s, rseq.l, seq->seq.s, seq->seq.l);
+	if (em) qs_emitseq(em, seq);
+	if (bam) {
+	  /* BAM mates share a name, so their flags tell them apart */
+	  if (!(flag1 & BAM_FREAD1) || !(flag & BAM_FREAD2)) {
+	    fprintf(stderr, "[%s] warning: BAM records '%s' and '%s' are not first and second mates\n", __func__, rname.s, seq->name.s);
+	    if (strict) return 1;
+	  }
+	} else if (!names_are_pair(rname.s, rname.l, rcomment.s, rcomment.l,
+				   seq->name.s, seq->name.l, seq->comment.s, seq->comment.l)) {
+	  fprintf(stderr, "[%s] warning: interleaved reads names differ '%s' != '%s'\n", __func__, rname.s, seq->name.s);
+	  if (strict) return 1;
+	}
+      } else {
+	fprintf(stderr, "[%s] error: interleaved file length not multiple of two.", __func__);
+	return 1;
+      }
+    }
+
+    if (tl_every && n_rec % tl_every == 0)
+      for (pr = 0; pr < interleaved+1; pr++)
+	qs_timeline_fprint(tl_fp, qs[pr], n_rec/tl_every, n_rec - tl_every + 1, interleaved ? pr+1 : 0);
+
+    if (ck_fn && n_rec % CLOCK_EVERY == 0 && now_sec() - ck_last >= ck_every) {
+      ck.n_rec = n_rec;
+      ck.rng = rng;
+      ck.offset = input_offset(fp, seq);
+      if (uio_tell(fp, ck.offset, &ck.voffset)) ck.voffset = UIO_NO_VOFF;
+      checkpoint_save(ck_fn, &ck, qs);
+      ck_last = now_sec();
+    }
+  }
+  free(rname.s); free(rcomment.s); free(rseq.s);
+  if (tl_fp) {
+    /* the last window is usually short */
+    if (n_rec % tl_every)
+      for (pr = 0; pr < interleaved+1; pr++)
+	qs_timeline_fprint(tl_fp, qs[pr], n_rec/tl_every + 1, n_rec - n_rec % tl_every + 1, interleaved ? pr+1 : 0);
+    fclose(tl_fp);
+  }
+  /* downstream sees the end of input before the statistics are written */
+  emit_destroy(em);
+
+  if (sample_n) {
+    n_res = n_rec < sample_n ? n_rec : sample_n;
+    for (pr = 0; pr < interleaved+1; pr++) {
+      /* these were already counted when they were read */
+      n_reads = qs[pr]->n_reads;
+      n_bases = qs[pr]->n_bases;
+      for (i = 0; i < n_res; i++)
+	update[pr](qs[pr], res[i*(interleaved+1) + pr], strict);
+      qs[pr]->n_reads = n_reads;
+      qs[pr]->n_bases = n_bases;
+    }
+    for (i = 0; i < sample_n*(interleaved+1); i++)
+      kseq_destroy(res[i]);
+    free(res);
+  }
+
+  for (g = 0; g < n_groups; g++) {
+    set = pool + g*(interleaved+1);
+    if (!set[0] || (dm && !set[0]->n_reads)) continue;
+    if (dm) {
+      gprefix.l = 0;
+      kputs(prefix, &gprefix);
+      kputs(g < dm->n ? dm->names[g] : "undetermined", &gprefix);
+      kputc('_', &gprefix);
+      outputs_open(&out, gprefix.s, interleaved+1, qtype, k, over_frac > 0, complexity, &opt, format);
+    }
+    outputs_write(&out, set, interleaved+1, &opt, format);
+  }
+  if (dm) {
+    demux_fp = open_output(prefix, "demux", ".txt");
+    demux_fprint(demux_fp, dm, qs[0]->n_reads);
+    fclose(demux_fp);
+    demux_destroy(dm);
+  }
+  free(gprefix.s);
+  if (has_prefix) free(prefix);
+  
+  if (spec) {
+    spectrum_fprint(spec_fp, spec);
+    fclose(spec_fp);
+    spectrum_destroy(spec);
+  }
+
+  if (ins) {
+    insert_fprint(insert_fp, ins);
+    fclose(insert_fp);
+    insert_destroy(ins);
+  }
+
+  /* the statistics are out, so a rerun should not resume */
+  if (ck_fn) unlink(ck_fn);
+
+  if (lv) {
+    qs_live_update(lv, &lst, qs, interleaved+1, fp, t0, 1);
+    live_close(lv);
+  }
+
+  for (pr = 0; pr < interleaved+1; pr++) {
+    if (qs[pr]->converged_at)
+      fprintf(stderr, "[%s] statistics converged after %llu reads\n", __func__,
+	      (long long unsigned int) qs[pr]->converged_at);
+    if (qs[pr]->sk)
+      fprintf(stderr, "[%s] approximate k-mer counts: lower bounds within %.0f, counts within %.0f of the truth (p > %.2f)\n", __func__,
+	      sketch_ss_error(qs[pr]->sk), sketch_cms_error(qs[pr]->sk), 1 - exp(-(double) qs[pr]->sk->depth));
+  }
+  for (i = 0; i < n_groups*(interleaved+1); i++) {
+    if (!pool[i]) continue;
+    arena_bytes += pool[i]->ka->reserved;
+    qs_destroy(pool[i]);
+  }
+  free(pool);
+
+  /* only on request, as a successful run is otherwise silent */
+  if (verbose) {
+    getrusage(RUSAGE_SELF, &ru);
+    fprintf(stderr, "[%s] peak memory: %.1f MB (arenas: %.1f MB)\n", __func__,
+	    ru.ru_maxrss/1024.0, arena_bytes/1048576.0);
   }
 
   kseq_destroy(seq);
-  gzclose(fp);
+  bam_close(bam);
+  uio_close(fp);
+  return 0;
 }
 #endif /* _SEQQS_MAIN */
@@ -0,0 +1,52 @@
+#ifndef SEQQS_H
+#define SEQQS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+   Library interface, for programs linking libseqqs (or the sources
+   built with -D_LIB_ONLY) instead of running seqqs. A set accumulates
+   per-position nucleotide and quality counts and read lengths; reads
+   are passed as plain buffers, so callers need no kseq. A set is not
+   thread-safe, but separate sets can be updated concurrently.
+*/
+
+typedef enum {
+  PHRED,
+  SANGER,
+  SOLEXA,
+  ILLUMINA,
+  NONE
+} qual_type;
+
+typedef struct _qs_set_t qs_set_t;
+
+/* the count matrices, one row per position (or position bin) */
+typedef enum {
+  QS_NTM, /* nucleotides, columns as in seq_nt17_rev_table */
+  QS_QM, /* qualities, columns from qs_qual_min() up */
+  QS_LM /* read lengths, one column */
+} qs_matrix_t;
+
+#define QS_SUMMARY_MAX 8
+
+extern char *seq_nt17_rev_table;
+
+qs_set_t *qs_init(qual_type qt, unsigned k, int binned);
+void qs_use_converge(qs_set_t *qs, double tol, uint64_t every);
+void qs_reserve(qs_set_t *qs, size_t nrow);
+size_t qs_capacity(const qs_set_t *qs);
+void qs_update_reads(qs_set_t *qs, size_t n, const char *const *seq, const size_t *len,
+		     const char *const *qual, const size_t *qlen, int strict);
+const uint64_t *qs_matrix(const qs_set_t *qs, qs_matrix_t which, size_t *nrow, size_t *ncol);
+int qs_qual_min(const qs_set_t *qs);
+unsigned qs_summary(const qs_set_t *qs, const char **names, uint64_t *vals);
+void qs_qm_fprint(FILE *file, qs_set_t *qs);
+void qs_ntm_fprint(FILE *file, qs_set_t *qs);
+void qs_lm_fprint(FILE *file, qs_set_t *qs);
+void qs_summary_fprint(FILE *file, qs_set_t *qs);
+void qs_destroy(qs_set_t *qs);
+
+#endif
@@ -0,0 +1,226 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "khash.h"
+#include "sketch.h"
+
+KHASH_MAP_INIT_INT64(fp, uint32_t)
+
+#define CMS_DEPTH 4
+#define CMS_SEED 0x5151ULL
+/* approximate bytes per Space-Saving entry, including the index */
+#define SS_ENTRY_BYTES(k) (sizeof(ss_entry_t) + (k) + sizeof(uint32_t) + 24)
+
+static uint64_t floor_pow2(uint64_t x) {
+  uint64_t p = 1;
+  while (p <= x/2) p <<= 1;
+  return p;
+}
+
+/* 
+   Half of the budget goes to the positional sketch, an eighth to the
+   k-mer sketch, and the rest to the Space-Saving table.
+*/
+qs_sketch_t *sketch_init(unsigned k, size_t mem) {
+  qs_sketch_t *sk = calloc(1, sizeof(qs_sketch_t));
+  sk->k = k;
+  sk->depth = CMS_DEPTH;
+  sk->width = floor_pow2(mem/2 / (CMS_DEPTH * sizeof(uint32_t)));
+  sk->kwidth = floor_pow2(mem/8 / (CMS_DEPTH * sizeof(uint32_t)));
+  sk->cap = (mem - mem/2 - mem/8) / SS_ENTRY_BYTES(k);
+  if (sk->width < 64 || sk->kwidth < 16 || sk->cap < 16) {
+    fprintf(stderr, "[%s] error: k-mer memory budget of %zu bytes is too small.\n", __func__, mem);
+    exit(1);
+  }
+  sk->cms = calloc(CMS_DEPTH * sk->width, sizeof(uint32_t));
+  sk->kcms = calloc(CMS_DEPTH * sk->kwidth, sizeof(uint32_t));
+  sk->e = malloc(sk->cap * sizeof(ss_entry_t));
+  sk->keys = malloc(sk->cap * k);
+  sk->heap = malloc(sk->cap * sizeof(uint32_t));
+  sk->index = kh_init(fp);
+  kh_resize(fp, (khash_t(fp) *) sk->index, sk->cap);
+  return sk;
+}
+
+/* 
+   Space-Saving alone, for cap items of k bytes; sketch_query() and
+   the enrichment totals are not available.
+*/
+qs_sketch_t *sketch_ss_init(unsigned k, size_t cap) {
+  qs_sketch_t *sk = calloc(1, sizeof(qs_sketch_t));
+  sk->k = k;
+  sk->cap = cap < 16 ? 16 : cap;
+  sk->e = malloc(sk->cap * sizeof(ss_entry_t));
+  sk->keys = malloc(sk->cap * k);
+  sk->heap = malloc(sk->cap * sizeof(uint32_t));
+  sk->index = kh_init(fp);
+  kh_resize(fp, (khash_t(fp) *) sk->index, sk->cap);
+  return sk;
+}
+
+static inline uint64_t item_fp(const char *kmer, unsigned k, uint32_t pos) {
+  return hash64(kmer, k, CMS_SEED + pos);
+}
+
+/* 
+   Conservative update: only the counters at the current minimum are
+   incremented, which never loses the upper bound and tightens it. 
+*/
+static uint64_t cms_add(uint32_t *cms, uint64_t width, unsigned depth, uint64_t h) {
+  unsigned i;
+  uint64_t j[CMS_DEPTH], h2 = (h >> 32) | 1;
+  uint32_t min = UINT32_MAX;
+  for (i = 0; i < depth; i++) {
+    j[i] = i*width + ((h + i*h2) & (width - 1));
+    if (cms[j[i]] < min) min = cms[j[i]];
+  }
+  if (min < UINT32_MAX) min++;
+  for (i = 0; i < depth; i++)
+    if (cms[j[i]] < min) cms[j[i]] = min;
+  return min;
+}
+
+static uint64_t cms_query(const uint32_t *cms, uint64_t width, unsigned depth, uint64_t h) {
+  unsigned i;
+  uint64_t h2 = (h >> 32) | 1;
+  uint32_t min = UINT32_MAX, c;
+  for (i = 0; i < depth; i++) {
+    c = cms[i*width + ((h + i*h2) & (width - 1))];
+    if (c < min) min = c;
+  }
+  return min;
+}
+
+static inline void heap_swap(qs_sketch_t *sk, size_t a, size_t b) {
+  uint32_t t = sk->heap[a];
+  sk->heap[a] = sk->heap[b];
+  sk->heap[b] = t;
+  sk->e[sk->heap[a]].hpos = a;
+  sk->e[sk->heap[b]].hpos = b;
+}
+
+static void heap_down(qs_sketch_t *sk, size_t i) {
+  size_t c;
+  while ((c = 2*i + 1) < sk->n) {
+    if (c + 1 < sk->n && sk->e[sk->heap[c+1]].count < sk->e[sk->heap[c]].count) c++;
+    if (sk->e[sk->heap[c]].count >= sk->e[sk->heap[i]].count) break;
+    heap_swap(sk, i, c);
+    i = c;
+  }
+}
+
+static void heap_up(qs_sketch_t *sk, size_t i) {
+  while (i > 0 && sk->e[sk->heap[i]].count < sk->e[sk->heap[(i-1)/2]].count) {
+    heap_swap(sk, i, (i-1)/2);
+    i = (i-1)/2;
+  }
+}
+
+static void ss_add(qs_sketch_t *sk, const char *kmer, uint64_t fp, uint32_t pos, uint32_t row);
+
+void sketch_add(qs_sketch_t *sk, const char *kmer, uint32_t pos, uint32_t row) {
+  uint64_t fp = item_fp(kmer, sk->k, pos);
+  cms_add(sk->cms, sk->width, sk->depth, fp);
+  cms_add(sk->kcms, sk->kwidth, sk->depth, hash64(kmer, sk->k, CMS_SEED));
+
+  if (row >= sk->nrow) {
+    size_t old = sk->nrow;
+    sk->nrow = row + 1;
+    kroundup32(sk->nrow);
+    sk->row_total = realloc(sk->row_total, sk->nrow * sizeof(uint64_t));
+    memset(sk->row_total + old, 0, (sk->nrow - old) * sizeof(uint64_t));
+  }
+  sk->row_total[row]++;
+  ss_add(sk, kmer, fp, pos, row);
+}
+
+void sketch_ss_add(qs_sketch_t *sk, const char *kmer, uint32_t pos, uint32_t row) {
+  ss_add(sk, kmer, item_fp(kmer, sk->k, pos), pos, row);
+}
+
+static void ss_add(qs_sketch_t *sk, const char *kmer, uint64_t fp, uint32_t pos, uint32_t row) {
+  khash_t(fp) *index = sk->index;
+  uint32_t id;
+  khiter_t it;
+  int ret;
+
+  sk->total++;
+  it = kh_put(fp, index, fp, &ret);
+  if (!ret) {
+    /* tracked: bump the count and restore the heap */
+    id = kh_value(index, it);
+    sk->e[id].count++;
+    heap_down(sk, sk->e[id].hpos);
+    return;
+  }
+
+  if (sk->n < sk->cap) {
+    id = sk->n;
+    sk->e[id].count = 1;
+    sk->e[id].err = 0;
+    sk->e[id].hpos = sk->n;
+    sk->heap[sk->n++] = id;
+  } else {
+    /* evict the minimum; the newcomer inherits its count as error */
+    id = sk->heap[0];
+    kh_del(fp, index, kh_get(fp, index, sk->e[id].fp));
+    it = kh_get(fp, index, fp);
+    sk->e[id].err = sk->e[id].count;
+    sk->e[id].count++;
+  }
+  kh_value(index, it) = id;
+  sk->e[id].fp = fp;
+  sk->e[id].pos = pos;
+  sk->e[id].row = row;
+  memcpy(sk->keys + (size_t) id*sk->k, kmer, sk->k);
+  if (sk->e[id].err) heap_down(sk, sk->e[id].hpos);
+  else heap_up(sk, sk->e[id].hpos);
+}
+
+uint64_t sketch_query(const qs_sketch_t *sk, const char *kmer, uint32_t pos) {
+  return cms_query(sk->cms, sk->width, sk->depth, item_fp(kmer, sk->k, pos));
+}
+
+uint64_t sketch_query_kmer(const qs_sketch_t *sk, const char *kmer) {
+  return cms_query(sk->kcms, sk->kwidth, sk->depth, hash64(kmer, sk->k, CMS_SEED));
+}
+
+static const qs_sketch_t *sort_sk;
+
+static int cmp_count_desc(const void *a, const void *b) {
+  const ss_entry_t *x = &sort_sk->e[*(const uint32_t *) a], *y = &sort_sk->e[*(const uint32_t *) b];
+  if (x->count != y->count) return x->count < y->count ? 1 : -1;
+  return x->pos < y->pos ? -1 : x->pos > y->pos;
+}
+
+/* entry ids of the tracked items by decreasing count; caller frees */
+uint32_t *sketch_sorted(const qs_sketch_t *sk) {
+  uint32_t *ids = malloc((sk->n + 1) * sizeof(uint32_t));
+  memcpy(ids, sk->heap, sk->n * sizeof(uint32_t));
+  sort_sk = sk;
+  qsort(ids, sk->n, sizeof(uint32_t), cmp_count_desc);
+  return ids;
+}
+
+/* count-min overestimate bound, held with probability 1 - exp(-depth) */
+double sketch_cms_error(const qs_sketch_t *sk) {
+  return exp(1.0) * sk->total / sk->width;
+}
+
+/* Space-Saving error bound: no tracked count is off by more than this */
+double sketch_ss_error(const qs_sketch_t *sk) {
+  return (double) sk->total / sk->cap;
+}
+
+void sketch_destroy(qs_sketch_t *sk) {
+  if (!sk) return;
+  free(sk->cms);
+  free(sk->kcms);
+  free(sk->e);
+  free(sk->keys);
+  free(sk->heap);
+  free(sk->row_total);
+  kh_destroy(fp, (khash_t(fp) *) sk->index);
+  free(sk);
+}
@@ -0,0 +1,72 @@
+#ifndef SKETCH_H
+#define SKETCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/* 
+   Approximate positional k-mer counting in fixed memory. Every
+   (k-mer, position) item goes into a conservative-update count-min
+   sketch, and a Space-Saving table of fixed capacity keeps the most
+   frequent items with a guaranteed lower bound on their counts. A
+   second, smaller count-min sketch counts k-mers regardless of
+   position, and per-position totals are kept exactly, for the
+   enrichment report.
+*/
+
+typedef struct {
+  uint64_t fp; /* fingerprint of (k-mer, position) */
+  uint64_t count, err; /* count - err <= true count <= count */
+  uint32_t pos; /* 1-indexed position label */
+  uint32_t row; /* matrix row of the position */
+  uint32_t hpos; /* index in the heap */
+} ss_entry_t;
+
+typedef struct {
+  unsigned k, depth;
+  uint64_t width, kwidth;
+  uint32_t *cms, *kcms;
+  uint64_t total; /* number of items counted */
+
+  /* Space-Saving: a min-heap on count over entry ids */
+  size_t n, cap;
+  ss_entry_t *e;
+  char *keys; /* k bytes per entry */
+  uint32_t *heap;
+  void *index; /* fingerprint -> entry id */
+
+  /* exact per-row totals */
+  size_t nrow;
+  uint64_t *row_total;
+} qs_sketch_t;
+
+qs_sketch_t *sketch_init(unsigned k, size_t mem);
+qs_sketch_t *sketch_ss_init(unsigned k, size_t cap);
+void sketch_add(qs_sketch_t *sk, const char *kmer, uint32_t pos, uint32_t row);
+void sketch_ss_add(qs_sketch_t *sk, const char *kmer, uint32_t pos, uint32_t row);
+uint64_t sketch_query(const qs_sketch_t *sk, const char *kmer, uint32_t pos);
+uint64_t sketch_query_kmer(const qs_sketch_t *sk, const char *kmer);
+uint32_t *sketch_sorted(const qs_sketch_t *sk);
+double sketch_cms_error(const qs_sketch_t *sk);
+double sketch_ss_error(const qs_sketch_t *sk);
+void sketch_destroy(qs_sketch_t *sk);
+
+/* 64-bit hash of n bytes */
+static inline uint64_t hash64(const char *s, size_t n, uint64_t seed) {
+  uint64_t h = seed ^ (n * 0x9e3779b97f4a7c15ULL), w;
+  while (n >= 8) {
+    memcpy(&w, s, 8);
+    h = (h ^ (w * 0xbf58476d1ce4e5b9ULL)) * 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    s += 8; n -= 8;
+  }
+  w = 0;
+  memcpy(&w, s, n);
+  h = (h ^ (w * 0xbf58476d1ce4e5b9ULL)) * 0x94d049bb133111ebULL;
+  h ^= h >> 29;
+  h *= 0xbf58476d1ce4e5b9ULL;
+  return h ^ (h >> 32);
+}
+
+#endif
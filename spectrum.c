@@ -0,0 +1,254 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "khash.h"
+#include "spectrum.h"
+
+KHASH_MAP_INIT_INT64(hist, uint64_t)
+
+#define SPECTRUM_EMPTY UINT64_MAX
+#define SPECTRUM_INIT_SIZE (1<<16)
+
+const unsigned char seq_nt4_table[256] = {
+  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
+  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
+  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
+  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
+  4, 0, 4, 1,  4, 4, 4, 2,  4, 4, 4, 4,  4, 4, 4, 4,
+  4, 4, 4, 4,  3, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
+  4, 0, 4, 1,  4, 4, 4, 2,  4, 4, 4, 4,  4, 4, 4, 4,
+  4, 4, 4, 4,  3, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
+  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
+  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
+  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
+  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
+  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
+  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
+  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
+  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4
+};
+
+/* invertible 64-bit mix, so partitions and slots are well spread */
+static inline uint64_t mix64(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33;
+  return x;
+}
+
+static void table_init(spec_table_t *t, uint64_t m) {
+  t->n = 0;
+  t->m = m;
+  t->keys = malloc(m * sizeof(uint64_t));
+  memset(t->keys, 0xff, m * sizeof(uint64_t));
+  t->counts = calloc(m, sizeof(uint32_t));
+}
+
+static void table_put(spec_table_t *t, uint64_t key, uint32_t count);
+
+static void table_grow(spec_table_t *t) {
+  spec_table_t old = *t;
+  uint64_t i;
+  table_init(t, old.m * 2);
+  for (i = 0; i < old.m; i++)
+    if (old.keys[i] != SPECTRUM_EMPTY) table_put(t, old.keys[i], old.counts[i]);
+  free(old.keys);
+  free(old.counts);
+}
+
+/* linear probing; counts saturate rather than wrap */
+static void table_put(spec_table_t *t, uint64_t key, uint32_t count) {
+  uint64_t i = mix64(key) & (t->m - 1);
+  while (t->keys[i] != SPECTRUM_EMPTY && t->keys[i] != key)
+    i = (i + 1) & (t->m - 1);
+  if (t->keys[i] == SPECTRUM_EMPTY) {
+    t->keys[i] = key;
+    if (++t->n * 10 > t->m * 7) {
+      t->counts[i] = count;
+      table_grow(t);
+      return;
+    }
+  }
+  t->counts[i] = (uint64_t) t->counts[i] + count > UINT32_MAX ? UINT32_MAX : t->counts[i] + count;
+}
+
+static void *spectrum_worker(void *data) {
+  spec_part_t *p = data;
+  spec_batch_t *b;
+  size_t i;
+  for (;;) {
+    pthread_mutex_lock(&p->lock);
+    while (!p->head && !p->done)
+      pthread_cond_wait(&p->cv, &p->lock);
+    b = p->head;
+    if (b) {
+      p->head = b->next;
+      if (!p->head) p->tail = NULL;
+    }
+    pthread_mutex_unlock(&p->lock);
+    if (!b) break;
+    for (i = 0; i < b->n; i++) table_put(&p->table, b->kmers[i], 1);
+    pthread_mutex_lock(&p->lock);
+    b->next = p->free;
+    p->free = b;
+    pthread_cond_signal(&p->space);
+    pthread_mutex_unlock(&p->lock);
+  }
+  return NULL;
+}
+
+spectrum_t *spectrum_init(unsigned k, int n_threads) {
+  unsigned i, bits = 0;
+  spectrum_t *sp = calloc(1, sizeof(spectrum_t));
+  if (k < 1 || k > SPECTRUM_MAX_K) {
+    fprintf(stderr, "[%s] error: spectrum k must be between 1 and %d.\n", __func__, SPECTRUM_MAX_K);
+    exit(1);
+  }
+  sp->k = k;
+  sp->mask = (1ULL << 2*k) - 1;
+  sp->threaded = n_threads > 1;
+  while ((1 << bits) < n_threads) bits++;
+  sp->n_parts = 1 << bits;
+  sp->shift = 64 - bits;
+  sp->parts = calloc(sp->n_parts, sizeof(spec_part_t));
+  sp->pending = calloc(sp->n_parts, sizeof(spec_batch_t*));
+  for (i = 0; i < sp->n_parts; i++) {
+    table_init(&sp->parts[i].table, SPECTRUM_INIT_SIZE);
+    if (!sp->threaded) continue;
+    pthread_mutex_init(&sp->parts[i].lock, NULL);
+    pthread_cond_init(&sp->parts[i].cv, NULL);
+    pthread_cond_init(&sp->parts[i].space, NULL);
+    pthread_create(&sp->parts[i].tid, NULL, spectrum_worker, &sp->parts[i]);
+  }
+  return sp;
+}
+
+static void spectrum_send(spectrum_t *sp, unsigned i) {
+  spec_part_t *p = &sp->parts[i];
+  spec_batch_t *b = sp->pending[i];
+  if (!b) return;
+  sp->pending[i] = NULL;
+  b->next = NULL;
+  pthread_mutex_lock(&p->lock);
+  if (p->tail) p->tail->next = b;
+  else p->head = b;
+  p->tail = b;
+  pthread_cond_signal(&p->cv);
+  pthread_mutex_unlock(&p->lock);
+}
+
+/* an empty batch for partition i, waiting while all of its batches are in flight */
+static spec_batch_t *spectrum_batch(spectrum_t *sp, unsigned i) {
+  spec_part_t *p = &sp->parts[i];
+  spec_batch_t *b;
+  pthread_mutex_lock(&p->lock);
+  while (!p->free && p->n_batches == SPECTRUM_QUEUE)
+    pthread_cond_wait(&p->space, &p->lock);
+  if ((b = p->free)) {
+    p->free = b->next;
+  } else {
+    b = malloc(sizeof(spec_batch_t));
+    p->n_batches++;
+  }
+  pthread_mutex_unlock(&p->lock);
+  b->n = 0;
+  return b;
+}
+
+void spectrum_add(spectrum_t *sp, uint64_t kmer) {
+  unsigned i;
+  spec_batch_t *b;
+  if (!sp->threaded) {
+    table_put(&sp->parts[0].table, kmer, 1);
+    return;
+  }
+  i = sp->n_parts > 1 ? mix64(kmer) >> sp->shift : 0;
+  b = sp->pending[i];
+  if (!b) b = sp->pending[i] = spectrum_batch(sp, i);
+  b->kmers[b->n++] = kmer;
+  if (b->n == SPECTRUM_BATCH) spectrum_send(sp, i);
+}
+
+/* flush partial batches and wait for the workers */
+void spectrum_finish(spectrum_t *sp) {
+  unsigned i;
+  if (!sp->threaded) return;
+  for (i = 0; i < sp->n_parts; i++) {
+    spectrum_send(sp, i);
+    pthread_mutex_lock(&sp->parts[i].lock);
+    sp->parts[i].done = 1;
+    pthread_cond_signal(&sp->parts[i].cv);
+    pthread_mutex_unlock(&sp->parts[i].lock);
+  }
+  for (i = 0; i < sp->n_parts; i++) {
+    pthread_join(sp->parts[i].tid, NULL);
+    pthread_mutex_destroy(&sp->parts[i].lock);
+    pthread_cond_destroy(&sp->parts[i].cv);
+    pthread_cond_destroy(&sp->parts[i].space);
+  }
+  sp->threaded = 0;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+  return x < y ? -1 : x > y;
+}
+
+/* histogram of multiplicities: how many distinct k-mers occur n times */
+void spectrum_fprint(FILE *file, spectrum_t *sp) {
+  khash_t(hist) *h = kh_init(hist);
+  khiter_t it;
+  uint64_t i, *mult, n = 0, distinct = 0;
+  unsigned j;
+  int ret;
+  spec_table_t *t;
+
+  spectrum_finish(sp);
+  for (j = 0; j < sp->n_parts; j++) {
+    t = &sp->parts[j].table;
+    distinct += t->n;
+    for (i = 0; i < t->m; i++) {
+      if (t->keys[i] == SPECTRUM_EMPTY) continue;
+      it = kh_put(hist, h, t->counts[i], &ret);
+      if (ret) kh_value(h, it) = 0;
+      kh_value(h, it)++;
+    }
+  }
+
+  mult = malloc((kh_size(h) + 1) * sizeof(uint64_t));
+  for (it = kh_begin(h); it != kh_end(h); ++it)
+    if (kh_exist(h, it)) mult[n++] = kh_key(h, it);
+  qsort(mult, n, sizeof(uint64_t), cmp_u64);
+
+  fprintf(file, "multiplicity\tcount\n");
+  for (i = 0; i < n; i++)
+    fprintf(file, "%llu\t%llu\n", (long long unsigned int) mult[i],
+	    (long long unsigned int) kh_value(h, kh_get(hist, h, mult[i])));
+  fputc('\n', file);
+
+  fprintf(stderr, "[%s] %u-mers: %llu total, %llu distinct\n", __func__, sp->k,
+	  (long long unsigned int) sp->n_kmers, (long long unsigned int) distinct);
+  free(mult);
+  kh_destroy(hist, h);
+}
+
+void spectrum_destroy(spectrum_t *sp) {
+  unsigned i;
+  spec_batch_t *b;
+  if (!sp) return;
+  spectrum_finish(sp);
+  for (i = 0; i < sp->n_parts; i++) {
+    while ((b = sp->parts[i].free)) {
+      sp->parts[i].free = b->next;
+      free(b);
+    }
+    free(sp->parts[i].table.keys);
+    free(sp->parts[i].table.counts);
+    free(sp->pending[i]);
+  }
+  free(sp->parts);
+  free(sp->pending);
+  free(sp);
+}
@@ -0,0 +1,83 @@
+#ifndef SPECTRUM_H
+#define SPECTRUM_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/* 
+   Whole-read k-mer abundance spectrum over canonical k-mers (k <= 31).
+   K-mers are pushed one base at a time from the main statistics loop
+   and partitioned by the top bits of their hash, one open-addressing
+   table per partition. With worker threads, each thread owns one
+   partition and receives batches of k-mers through its own queue, so
+   tables are never shared. Each partition owns SPECTRUM_QUEUE batches,
+   which go back to a free list once counted; when all are in flight
+   the reader waits, so memory stays fixed if the workers fall behind.
+*/
+
+#define SPECTRUM_MAX_K 31
+#define SPECTRUM_BATCH 4096
+#define SPECTRUM_QUEUE 8
+
+typedef struct {
+  uint64_t *keys; /* SPECTRUM_EMPTY marks a free slot */
+  uint32_t *counts;
+  uint64_t n, m;
+} spec_table_t;
+
+typedef struct _spec_batch_t {
+  struct _spec_batch_t *next;
+  size_t n;
+  uint64_t kmers[SPECTRUM_BATCH];
+} spec_batch_t;
+
+typedef struct {
+  pthread_t tid;
+  pthread_mutex_t lock;
+  pthread_cond_t cv, space;
+  spec_batch_t *head, *tail; /* queued batches */
+  spec_batch_t *free; /* counted batches, for reuse */
+  unsigned n_batches; /* allocated so far, at most SPECTRUM_QUEUE */
+  int done;
+  spec_table_t table;
+} spec_part_t;
+
+typedef struct {
+  unsigned k, n_parts, shift;
+  int threaded;
+  uint64_t mask, n_kmers;
+  spec_part_t *parts;
+  spec_batch_t **pending; /* batch being filled, per partition */
+} spectrum_t;
+
+/* rolling state of the current read */
+typedef struct {
+  uint64_t fw, rv;
+  unsigned len;
+} spec_roll_t;
+
+extern const unsigned char seq_nt4_table[256];
+
+spectrum_t *spectrum_init(unsigned k, int n_threads);
+void spectrum_add(spectrum_t *sp, uint64_t kmer);
+void spectrum_finish(spectrum_t *sp);
+void spectrum_fprint(FILE *file, spectrum_t *sp);
+void spectrum_destroy(spectrum_t *sp);
+
+/* push the next base of a read; non-ACGT bases restart the k-mer */
+static inline void spectrum_base(spectrum_t *sp, spec_roll_t *r, char c) {
+  uint64_t b = seq_nt4_table[(unsigned char) c];
+  if (b > 3) {
+    r->len = 0;
+    return;
+  }
+  r->fw = ((r->fw << 2) | b) & sp->mask;
+  r->rv = (r->rv >> 2) | ((3 - b) << (2*(sp->k - 1)));
+  if (++r->len >= sp->k) {
+    spectrum_add(sp, r->fw < r->rv ? r->fw : r->rv);
+    sp->n_kmers++;
+  }
+}
+
+#endif
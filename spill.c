@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "spill.h"
+
+#define SPILL_BUFSIZE (1<<20)
+/* runs are merged into one once there are this many open */
+#define SPILL_MAX_RUNS 128
+
+/* 
+   Run files are created in $TMPDIR (or /tmp) and unlinked straight
+   away, so they disappear however seqqs exits.
+*/
+static FILE *spill_tmpfile(void) {
+  const char *dir = getenv("TMPDIR");
+  char *fn;
+  int fd;
+  FILE *fp;
+  if (!dir || !*dir) dir = "/tmp";
+  fn = malloc(strlen(dir) + 20);
+  sprintf(fn, "%s/seqqs-XXXXXX", dir);
+  fd = mkstemp(fn);
+  if (fd < 0) {
+    fprintf(stderr, "[%s] error: cannot create a temporary file in '%s'.\n", __func__, dir);
+    exit(1);
+  }
+  unlink(fn);
+  free(fn);
+  fp = fdopen(fd, "w+");
+  setvbuf(fp, NULL, _IOFBF, SPILL_BUFSIZE);
+  return fp;
+}
+
+spill_t *spill_init(unsigned k) {
+  spill_t *sp = calloc(1, sizeof(spill_t));
+  sp->k = k;
+  sp->rec_size = k + sizeof(uint32_t) + sizeof(uint64_t);
+  return sp;
+}
+
+static void put_le(char *p, uint64_t x, int width) {
+  int i;
+  for (i = 0; i < width; i++) p[i] = (char) ((x >> (8*i)) & 0xff);
+}
+
+static uint64_t get_le(const char *p, int width) {
+  int i;
+  uint64_t x = 0;
+  for (i = 0; i < width; i++) x |= (uint64_t) (unsigned char) p[i] << (8*i);
+  return x;
+}
+
+static void spill_put(spill_t *sp, FILE *fp, char *rec, const kmer_rec_t *r) {
+  memcpy(rec, r->kmer, sp->k);
+  put_le(rec + sp->k, r->pos, 4);
+  put_le(rec + sp->k + 4, r->count, 8);
+  if (fwrite(rec, sp->rec_size, 1, fp) != 1) {
+    fprintf(stderr, "[%s] error: cannot write k-mer run (disk full?).\n", __func__);
+    exit(1);
+  }
+}
+
+static FILE *spill_new_run(spill_t *sp) {
+  if (sp->n_runs == sp->m_runs) {
+    sp->m_runs = sp->m_runs ? sp->m_runs*2 : 8;
+    sp->runs = realloc(sp->runs, sp->m_runs * sizeof(FILE*));
+  }
+  return sp->runs[sp->n_runs++] = spill_tmpfile();
+}
+
+/* merge all runs into a single one, keeping open files bounded */
+static void spill_compact(spill_t *sp) {
+  int r, n_runs = sp->n_runs;
+  FILE *fp = spill_tmpfile();
+  char *rec = malloc(sp->rec_size);
+  kmer_rec_t kr;
+  spill_merge_t *m = spill_merge_init(sp);
+  while (spill_merge_next(m, &kr))
+    spill_put(sp, fp, rec, &kr);
+  fflush(fp);
+  spill_merge_destroy(m);
+  for (r = 0; r < n_runs; r++) fclose(sp->runs[r]);
+  sp->runs[0] = fp;
+  sp->n_runs = 1;
+  free(rec);
+}
+
+/* write one run; recs must already be sorted */
+void spill_run(spill_t *sp, const kmer_rec_t *recs, size_t n) {
+  size_t i;
+  FILE *fp = spill_new_run(sp);
+  char *rec = malloc(sp->rec_size);
+  for (i = 0; i < n; i++)
+    spill_put(sp, fp, rec, &recs[i]);
+  fflush(fp);
+  sp->n_recs += n;
+  free(rec);
+  if (sp->n_runs >= SPILL_MAX_RUNS) spill_compact(sp);
+}
+
+#define run_rec(m, r) ((m)->buf + (size_t) (r)*(m)->sp->rec_size)
+
+static int run_lt(const spill_merge_t *m, int a, int b) {
+  unsigned k = m->sp->k;
+  const char *x = run_rec(m, a), *y = run_rec(m, b);
+  return kmer_rec_cmp(x, get_le(x + k, 4), y, get_le(y + k, 4), k) < 0;
+}
+
+static void merge_down(spill_merge_t *m, int i) {
+  int c, t;
+  while ((c = 2*i + 1) < m->n) {
+    if (c + 1 < m->n && run_lt(m, m->heap[c+1], m->heap[c])) c++;
+    if (!run_lt(m, m->heap[c], m->heap[i])) break;
+    t = m->heap[i]; m->heap[i] = m->heap[c]; m->heap[c] = t;
+    i = c;
+  }
+}
+
+/* starts a merge from the beginning of every run */
+spill_merge_t *spill_merge_init(spill_t *sp) {
+  int r, i;
+  spill_merge_t *m = calloc(1, sizeof(spill_merge_t));
+  m->sp = sp;
+  m->heap = malloc((sp->n_runs + 1) * sizeof(int));
+  m->buf = malloc((sp->n_runs + 1) * sp->rec_size);
+  m->kmer = malloc(sp->k + 1);
+  for (r = 0; r < sp->n_runs; r++) {
+    rewind(sp->runs[r]);
+    if (fread(run_rec(m, r), sp->rec_size, 1, sp->runs[r]) == 1)
+      m->heap[m->n++] = r;
+  }
+  for (i = m->n/2 - 1; i >= 0; i--) merge_down(m, i);
+  return m;
+}
+
+/* 
+   Next record in order, with the counts of equal (k-mer, position)
+   records from different runs summed. rec->kmer is valid until the
+   next call. Returns 0 at the end.
+*/
+int spill_merge_next(spill_merge_t *m, kmer_rec_t *rec) {
+  unsigned k = m->sp->k;
+  int r;
+  const char *p;
+  if (!m->n) return 0;
+  p = run_rec(m, m->heap[0]);
+  memcpy(m->kmer, p, k);
+  rec->kmer = m->kmer;
+  rec->pos = get_le(p + k, 4);
+  rec->count = 0;
+  while (m->n) {
+    r = m->heap[0];
+    p = run_rec(m, r);
+    if (kmer_rec_cmp(p, get_le(p + k, 4), rec->kmer, rec->pos, k)) break;
+    rec->count += get_le(p + k + 4, 8);
+    if (fread(run_rec(m, r), m->sp->rec_size, 1, m->sp->runs[r]) != 1)
+      m->heap[0] = m->heap[--m->n];
+    merge_down(m, 0);
+  }
+  return 1;
+}
+
+void spill_merge_destroy(spill_merge_t *m) {
+  if (!m) return;
+  free(m->heap);
+  free(m->buf);
+  free(m->kmer);
+  free(m);
+}
+
+void spill_destroy(spill_t *sp) {
+  int r;
+  if (!sp) return;
+  for (r = 0; r < sp->n_runs; r++) fclose(sp->runs[r]);
+  free(sp->runs);
+  free(sp);
+}
@@ -0,0 +1,49 @@
+#ifndef SPILL_H
+#define SPILL_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+/* 
+   Exact positional k-mer counting beyond memory: sorted runs of
+   packed (k-mer, position, count) records are spilled to temporary
+   files and combined with a streaming k-way merge. Records are
+   ordered by position, then by k-mer bytes.
+*/
+
+typedef struct {
+  const char *kmer; /* k bytes, not terminated */
+  uint32_t pos;
+  uint64_t count;
+} kmer_rec_t;
+
+typedef struct {
+  unsigned k;
+  size_t rec_size;
+  int n_runs, m_runs;
+  FILE **runs;
+  uint64_t n_recs; /* records written over all runs */
+} spill_t;
+
+typedef struct {
+  spill_t *sp;
+  int n; /* runs still in the heap */
+  int *heap;
+  char *buf; /* current record of each run */
+  char *kmer; /* k-mer of the record being returned */
+} spill_merge_t;
+
+static inline int kmer_rec_cmp(const char *a, uint32_t pa, const char *b, uint32_t pb, unsigned k) {
+  if (pa != pb) return pa < pb ? -1 : 1;
+  return memcmp(a, b, k);
+}
+
+spill_t *spill_init(unsigned k);
+void spill_run(spill_t *sp, const kmer_rec_t *recs, size_t n);
+spill_merge_t *spill_merge_init(spill_t *sp);
+int spill_merge_next(spill_merge_t *m, kmer_rec_t *rec);
+void spill_merge_destroy(spill_merge_t *m);
+void spill_destroy(spill_t *sp);
+
+#endif
@@ -0,0 +1,134 @@
+# Tests for the Python bindings; build them first with 'make python'.
+# The counts seqqs.Stats exposes are checked against ones made here,
+# along with the rules for views of the matrices.
+
+import os
+import sys
+import random
+import threading
+
+sys.path.insert(0, os.path.abspath("../python"))
+import seqqs
+
+def random_batch(n, length, seed=1):
+    rng = random.Random(seed)
+    seqs = list()
+    quals = list()
+    for i in range(n):
+        l = rng.randint(length // 2, length)
+        seqs.append("".join(rng.choice("ACGTN") for _ in range(l)).encode())
+        quals.append("".join(chr(33 + rng.randint(0, 40)) for _ in range(l)).encode())
+    return seqs, quals
+
+def expected_ntm(seqs):
+    rows = [[0] * len(seqqs.NT_COLUMNS) for _ in range(max(len(s) for s in seqs))]
+    for s in seqs:
+        for i, b in enumerate(s.decode()):
+            rows[i][seqqs.NT_COLUMNS.index(b)] += 1
+    return rows
+
+def test_counts():
+    """update() counts what the reads hold, and summary() totals them."""
+    seqs, quals = random_batch(300, 80)
+    st = seqqs.Stats(qual="sanger")
+    st.update(seqs[:100], quals[:100])
+    st.update(seqs[100:], quals[100:])
+    results = list()
+    s = st.summary()
+    results.append(s["reads"] == 300 and s["bases"] == sum(len(x) for x in seqs))
+    ntm = memoryview(st.ntm)
+    results.append(ntm.format == "Q" and ntm.readonly)
+    results.append(ntm.shape == (max(len(x) for x in seqs), len(seqqs.NT_COLUMNS)))
+    results.append(ntm.tolist() == expected_ntm(seqs))
+    lm = memoryview(st.lm).tolist()
+    results.append(all(lm[i] == sum(len(x) == i + 1 for x in seqs) for i in range(len(lm))))
+    qm = memoryview(st.qm).tolist()
+    results.append(sum(qm[0]) == 300)
+    results.append(all(qm[0][q - 33 - st.qual_min] == sum(x[0] == q for x in quals) for q in range(33, 74)))
+    return all(results)
+
+def test_views_in_place():
+    """A view is the matrix itself, not a copy, so it follows later updates."""
+    seqs, quals = random_batch(200, 60, seed=2)
+    st = seqqs.Stats(qual="sanger", max_len=60)
+    st.update(seqs[:50], quals[:50])
+    ntm = memoryview(st.ntm)
+    st.update(seqs[50:], quals[50:])
+    return ntm.tolist()[:max(len(x) for x in seqs)] == expected_ntm(seqs)
+
+def test_fasta():
+    """Without a quality type there is no quality matrix, and no qualities are needed."""
+    seqs, quals = random_batch(50, 40, seed=3)
+    st = seqqs.Stats(qual=None)
+    st.update(seqs)
+    return st.qm is None and memoryview(st.ntm).tolist() == expected_ntm(seqs)
+
+def test_growth():
+    """
+    While a view is alive, a read past the reserved rows raises
+    BufferError rather than moving the matrices; max_len reserves them.
+    """
+    results = list()
+    st = seqqs.Stats(qual="sanger")
+    st.update([b"ACGT" * 10], [b"I" * 40])
+    ntm = memoryview(st.ntm)
+    try:
+        st.update([b"ACGT" * 100], [b"I" * 400])
+        results.append(False)
+    except BufferError:
+        results.append(st.summary()["reads"] == 1)
+    # nor can the set be reinitialized under a view
+    try:
+        st.__init__(qual="sanger")
+        results.append(False)
+    except BufferError:
+        results.append(True)
+    ntm.release()
+    st.update([b"ACGT" * 100], [b"I" * 400])
+    results.append(st.summary()["reads"] == 2 and memoryview(st.ntm).shape[0] == 400)
+
+    # the view keeps the rows it was taken with, and follows them in place
+    st = seqqs.Stats(qual="sanger", max_len=500)
+    st.update([b"ACGT" * 10], [b"I" * 40])
+    ntm = memoryview(st.ntm)
+    st.update([b"ACGT" * 100], [b"I" * 400])
+    results.append(st.summary()["reads"] == 2 and ntm.shape[0] == 40)
+    results.append(ntm.tolist()[0][seqqs.NT_COLUMNS.index("A")] == 2)
+    results.append(memoryview(st.ntm).tolist()[399][seqqs.NT_COLUMNS.index("T")] == 1)
+    return all(results)
+
+def test_reinit_while_updating():
+    """
+    Reinitializing a Stats that another thread is updating, with the
+    GIL released, raises RuntimeError instead of freeing the set under it.
+    """
+    seqs, quals = random_batch(2000, 150, seed=4)
+    st = seqqs.Stats(qual="sanger", max_len=150)
+    refused = list()
+    worker = threading.Thread(target=lambda: [st.update(seqs, quals) for _ in range(50)])
+    worker.start()
+    while worker.is_alive():
+        try:
+            st.__init__(qual="sanger", max_len=150)
+        except RuntimeError:
+            refused.append(True)
+    worker.join()
+    return len(refused) > 0 and st.summary()["reads"] % 2000 == 0
+
+if __name__ == "__main__":
+    tests = list()
+    tests.append(("test_counts", test_counts()))
+    tests.append(("test_views_in_place", test_views_in_place()))
+    tests.append(("test_fasta", test_fasta()))
+    tests.append(("test_growth", test_growth()))
+    tests.append(("test_reinit_while_updating", test_reinit_while_updating()))
+    total = 0
+    passed = 0
+    print("results:")
+    for name, value in tests:
+        total += 1
+        passed += int(value)
+        print("\t%s\t%s" % (name, ["Failed", "Passed"][int(value)]))
+    if passed < total:
+        sys.exit("%d/%d tests failed!\n" % (total - passed, total))
+    sys.stderr.write("%d/%d tests passed.\n" % (passed, total))
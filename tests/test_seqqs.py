@@ -0,0 +1,519 @@
+# Regression tests for seqqs statistics: options that take a different
+# route through the code (sampling, spilling, resuming, BAM input,
+# demultiplexing) must give the same numbers as the plain path.
+
+import sys
+import os
+import random
+import gzip
+import json
+import shutil
+import struct
+import tempfile
+import time
+import zlib
+from subprocess import call, Popen, PIPE
+
+SEQQS = os.path.abspath("../seqqs")
+PAIRS = os.path.abspath("../pairs")
+devnull = open(os.devnull, 'w')
+
+def random_reads(n, length=100, seed=1):
+    """n random (name, sequence, quality) triples."""
+    rng = random.Random(seed)
+    reads = list()
+    for i in range(n):
+        l = rng.randint(length // 2, length)
+        seq = "".join(rng.choice("ACGTN" if i % 50 == 0 else "ACGT") for _ in range(l))
+        qual = "".join(chr(33 + rng.randint(2, 40)) for _ in range(l))
+        reads.append(("r%d" % i, seq, qual))
+    return reads
+
+def write_fastq(fn, reads):
+    with open(fn, "w") as f:
+        for name, seq, qual in reads:
+            f.write("@%s\n%s\n+\n%s\n" % (name, seq, qual))
+
+def make_reads(fn, n, length=100, seed=1):
+    """Write n random FASTQ records; returns the total number of bases."""
+    reads = random_reads(n, length, seed)
+    write_fastq(fn, reads)
+    return sum(len(seq) for name, seq, qual in reads)
+
+def bgzf_block(data):
+    c = zlib.compressobj(6, zlib.DEFLATED, -15)
+    z = c.compress(data) + c.flush()
+    return (struct.pack("<BBBBIBBHBBHH", 31, 139, 8, 4, 0, 0, 255, 6, 66, 67, 2, len(z) + 25)
+            + z + struct.pack("<II", zlib.crc32(data) & 0xffffffff, len(data)))
+
+def write_bgzf(fn, data, block_size=65280):
+    """BGZF, as from bgzip, with the empty block marking the end."""
+    with open(fn, "wb") as f:
+        for i in range(0, len(data), block_size):
+            f.write(bgzf_block(data[i:i + block_size]))
+        f.write(bgzf_block(b""))
+
+def bam_record(name, seq, qual, flag):
+    """An unmapped record; a reverse-strand one is stored reverse-complemented."""
+    if flag & 0x10:
+        seq = "".join({"A": "T", "C": "G", "G": "C", "T": "A", "N": "N"}[b] for b in reversed(seq))
+        qual = qual[::-1]
+    packed = bytearray()
+    for i in range(0, len(seq), 2):
+        packed.append("=ACMGRSVTWYHKDBN".index(seq[i]) << 4
+                      | ("=ACMGRSVTWYHKDBN".index(seq[i + 1]) if i + 1 < len(seq) else 0))
+    body = struct.pack("<iiBBHHHIiii", -1, -1, len(name) + 1, 0, 4680, 0, flag, len(seq), -1, -1, 0)
+    body += name.encode() + b"\0" + bytes(packed) + bytes(ord(c) - 33 for c in qual)
+    return struct.pack("<I", len(body)) + body
+
+def write_bam(fn, records):
+    """An unaligned BAM with no header text and no references."""
+    data = b"BAM\1" + struct.pack("<II", 0, 0)
+    write_bgzf(fn, data + b"".join(bam_record(*r) for r in records))
+
+def run(args, tmp):
+    cmd = [SEQQS] + args
+    print("running: " + " ".join(cmd))
+    return call(cmd, cwd=tmp, stdout=devnull, stderr=devnull)
+
+def same_files(tmp, p1, p2, names):
+    same = True
+    for name in names:
+        with open(os.path.join(tmp, p1 + name)) as f1, open(os.path.join(tmp, p2 + name)) as f2:
+            if f1.read() != f2.read():
+                print("differs: %s%s %s%s" % (p1, name, p2, name))
+                same = False
+    return same
+
+def read_summary(fn):
+    summary = dict()
+    with open(fn) as f:
+        for line in f:
+            fields = line.split()
+            if len(fields) == 2:
+                summary[fields[0]] = int(fields[1])
+    return summary
+
+def test_sample_totals(tmp):
+    """
+    Sampling changes which reads the matrices see, never the read and
+    base totals.
+    """
+    results = list()
+    fq = os.path.join(tmp, "sample.fq")
+    bases = make_reads(fq, 2000)
+    # options, and the number of reads the matrices should see
+    for opts, sampled in ((["--sample-n", "100"], 100),
+                          (["--sample-n", "5000"], 2000),
+                          (["--sample-frac", "0.1"], None)):
+        results.append(run(opts + ["-p", "s_", fq], tmp) == 0)
+        s = read_summary(os.path.join(tmp, "s__summary.txt"))
+        results.append(s["reads"] == 2000 and s["bases"] == bases)
+        results.append(sampled is None or s["sampled_reads"] == sampled)
+    results.append(run(["-i", "--sample-n", "100", "-p", "p_", fq], tmp) == 0)
+    s1 = read_summary(os.path.join(tmp, "p__summary_1.txt"))
+    s2 = read_summary(os.path.join(tmp, "p__summary_2.txt"))
+    results.append(s1["reads"] + s2["reads"] == 2000)
+    results.append(s1["bases"] + s2["bases"] == bases)
+    results.append(s1["sampled_reads"] == s2["sampled_reads"] == 100)
+    return all(results)
+
+def test_kmer_spill(tmp):
+    """
+    Spilling the k-mer table to disk changes where the counts are kept,
+    never the counts.
+    """
+    fq = os.path.join(tmp, "spill.fq")
+    make_reads(fq, 5000)
+    results = list()
+    results.append(run(["-k", "5", "--kmer-all", "-p", "mem_", fq], tmp) == 0)
+    os.environ["TMPDIR"] = tmp
+    results.append(run(["-k", "5", "--kmer-all", "--kmer-spill", "64K", "-p", "spill_", fq], tmp) == 0)
+    results.append(same_files(tmp, "mem_", "spill_", ["_kmer.txt", "_kmer_enrich.txt", "_nucl.txt"]))
+    return all(results)
+
+def kill_at_checkpoint(args, tmp, ck):
+    """
+    Run seqqs and kill it as soon as it has saved a checkpoint; a run
+    that finishes first is tried again. Returns whether it was caught.
+    """
+    for attempt in range(10):
+        p = Popen([SEQQS] + args, cwd=tmp, stdout=devnull, stderr=devnull)
+        while p.poll() is None and not os.path.exists(ck):
+            time.sleep(0.001)
+        p.kill()
+        p.wait()
+        if os.path.exists(ck):
+            return True
+    return False
+
+def test_resume(tmp):
+    """
+    A run killed after a checkpoint and resumed gives the same tables as
+    one that was never interrupted, from plain input and from BGZF,
+    which resumes from the block holding the next record.
+    """
+    results = list()
+    fq = os.path.join(tmp, "resume.fq")
+    write_fastq(fq, random_reads(40000, seed=2))
+    with open(fq, "rb") as f:
+        bgz = os.path.join(tmp, "resume.fq.gz")
+        write_bgzf(bgz, f.read(), 4000)
+    ck = os.path.join(tmp, "resume.ck")
+    outputs = ["_len.txt", "_nucl.txt", "_qual.txt", "_summary.txt", "_kmer_enrich.txt"]
+    for fn in (fq, bgz):
+        results.append(run(["-k", "4", "-p", "full_", fn], tmp) == 0)
+        results.append(kill_at_checkpoint(["-k", "4", "--checkpoint", ck, "--checkpoint-every", "0.001",
+                                           "-p", "killed_", fn], tmp, ck))
+        results.append(run(["-k", "4", "--checkpoint", ck, "--resume", "-p", "resumed_", fn], tmp) == 0)
+        results.append(same_files(tmp, "full_", "resumed_", outputs))
+        results.append(not os.path.exists(ck))
+    return all(results)
+
+def test_pair_names(tmp):
+    """
+    Interleaved mates pair up by name whether the mate is tagged /1 /2,
+    by an SRA-style .1 .2 suffix, or in a Casava 1.8 comment; with -s,
+    anything else is an error.
+    """
+    fq = os.path.join(tmp, "names.fq")
+    results = list()
+    for names, paired in ((("r1/1", "r1/2"), True),
+                          (("r1", "r1"), True),
+                          (("r1 1:N:0:ACGT", "r1 2:N:0:ACGT"), True),
+                          (("r1 1:Y:0:ACGT", "r1 2:N:0:ACGT"), True),
+                          (("SRR001666.7.1", "SRR001666.7.2"), True),
+                          (("SRR001666.7.1 len=4", "SRR001666.7.2 len=4"), True),
+                          (("r1/2", "r1/1"), False),
+                          (("r1 2:N:0:ACGT", "r1 1:N:0:ACGT"), False),
+                          (("SRR001666.7.1", "SRR001666.8.2"), False),
+                          (("r1", "r2"), False)):
+        with open(fq, "w") as f:
+            for name in names:
+                f.write("@%s\nACGT\n+\nIIII\n" % name)
+        results.append((run(["-i", "-s", "-p", "n_", fq], tmp) == 0) == paired)
+    return all(results)
+
+def test_bam(tmp):
+    """
+    An unaligned BAM gives the same statistics as the FASTQ it was made
+    from: secondary and supplementary records are skipped, and mates on
+    the reverse strand are turned back.
+    """
+    reads = random_reads(2000, seed=3)
+    fq = os.path.join(tmp, "bam.fq")
+    write_fastq(fq, [(name + "/%d" % (i % 2 + 1), seq, qual) for i, (name, seq, qual) in enumerate(reads)])
+    records = list()
+    for i in range(0, len(reads), 2):
+        name = reads[i][0]
+        records.append((name, reads[i][1], reads[i][2], 0x1 | 0x40))
+        records.append((name, reads[i + 1][1], reads[i + 1][2], 0x1 | 0x80 | (0x10 if i % 4 == 0 else 0)))
+        if i % 10 == 0:
+            records.append((name, "ACGT", "IIII", 0x1 | 0x40 | 0x100))
+            records.append((name, "ACGT", "IIII", 0x1 | 0x80 | 0x800))
+    bam = os.path.join(tmp, "in.bam")
+    write_bam(bam, records)
+    results = list()
+    results.append(run(["-i", "-p", "fq_", fq], tmp) == 0)
+    results.append(run(["-i", "-p", "bam_", bam], tmp) == 0)
+    results.append(same_files(tmp, "fq_", "bam_", ["_%s_%d.txt" % (t, m) for t in ("len", "nucl", "qual", "summary")
+                                                    for m in (1, 2)]))
+    # -e turns the records back into the FASTQ they came from
+    with open(os.path.join(tmp, "bam.out.fq"), "w") as f:
+        results.append(call([SEQQS, "-e", "-i", "-p", "e_", bam], cwd=tmp, stdout=f, stderr=devnull) == 0)
+    with open(os.path.join(tmp, "bam.out.fq")) as f:
+        lines = f.read().split("\n")
+    results.append(lines[1::4][:len(reads)] == [seq for name, seq, qual in reads])
+    results.append(lines[3::4][:len(reads)] == [qual for name, seq, qual in reads])
+    # a corrupt record size is an error, not an allocation of gigabytes
+    for size in (0xfffffff0, 8):
+        write_bgzf(bam, b"BAM\1" + struct.pack("<III", 0, 0, size) + bytes(64))
+        results.append(run(["-p", "bad_", bam], tmp) == 1)
+    return all(results)
+
+def test_insert(tmp):
+    """
+    Insert sizes come from the overlap of the mates, including pairs
+    that read through into the adapter; mates that do not overlap are
+    not counted.
+    """
+    rng = random.Random(5)
+    comp = {"A": "T", "C": "G", "G": "C", "T": "A"}
+    adapters = ("AGATCGGAAGAGCACACGTCTGAACTCCAGTCA" * 4, "AGATCGGAAGAGCGTCGTGTAGGGAAAGAGTGT" * 4)
+    # insert size, and how many pairs have it
+    counts = ((60, 3), (80, 5), (120, 7), (150, 2), (250, 4))
+    fq = os.path.join(tmp, "insert.fq")
+    with open(fq, "w") as f:
+        i = 0
+        for size, n in counts:
+            for _ in range(n):
+                frag = "".join(rng.choice("ACGT") for _ in range(size))
+                rc = "".join(comp[b] for b in reversed(frag))
+                for mate, s in ((1, (frag + adapters[0])[:100]), (2, (rc + adapters[1])[:100])):
+                    f.write("@p%d/%d\n%s\n+\n%s\n" % (i, mate, s, "I" * len(s)))
+                i += 1
+    results = list()
+    results.append(run(["-i", "--insert", "-p", "ins_", fq], tmp) == 0)
+    columns, rows = read_table(os.path.join(tmp, "ins__insert.txt"))
+    results.append(columns == ["insert", "pairs"])
+    results.append(rows == [[size, n] for size, n in counts if size < 200])
+    return all(results)
+
+def test_pairs_stats(tmp):
+    """
+    pairs split --stats and pairs join --stats give the same statistics
+    as running seqqs on the files they read or write.
+    """
+    reads = random_reads(600, seed=6)
+    inter = os.path.join(tmp, "inter.fq")
+    with open(inter, "w") as f:
+        for i in range(0, len(reads), 2):
+            (n1, s1, q1), (n2, s2, q2) = reads[i], reads[i + 1]
+            # every tenth pair lost its second mate; both records go to the unpaired file
+            if i % 20 == 0:
+                s2, q2 = "N", "#"
+            f.write("@%s/1\n%s\n+\n%s\n@%s/2\n%s\n+\n%s\n" % (n1, s1, q1, n1, s2, q2))
+    outputs = ["_qual.txt", "_nucl.txt", "_len.txt", "_summary.txt"]
+    results = list()
+    split = [os.path.join(tmp, "split_%s.fq" % name) for name in ("1", "2", "u")]
+    cmd = [PAIRS, "split", "--stats", "ps", "-1", split[0], "-2", split[1], "-u", split[2], inter]
+    print("running: " + " ".join(cmd))
+    results.append(call(cmd, cwd=tmp, stdout=devnull, stderr=devnull) == 0)
+    for fn, name in zip(split, ("R1", "R2", "unpaired")):
+        results.append(run(["-p", "seqqs_" + name, fn], tmp) == 0)
+        results.append(same_files(tmp, "ps_" + name, "seqqs_" + name, outputs))
+    results.append(read_summary(os.path.join(tmp, "ps_unpaired_summary.txt"))["reads"] == 30)
+
+    with open(os.path.join(tmp, "joined.fq"), "w") as f:
+        cmd = [PAIRS, "join", "--stats", "pj", split[0], split[1]]
+        print("running: " + " ".join(cmd))
+        results.append(call(cmd, cwd=tmp, stdout=f, stderr=devnull) == 0)
+    for fn, name in zip(split, ("R1", "R2")):
+        results.append(same_files(tmp, "pj_" + name, "seqqs_" + name, outputs))
+    return all(results)
+
+def test_codecs(tmp):
+    """
+    The codec is chosen by the input's first bytes, not its name:
+    plain, gzip (one member or several), BGZF (split between threads),
+    and, in a build with ZSTD=1, zstd as one frame or many, all give
+    the tables of the plain file.
+    """
+    fq = os.path.join(tmp, "codec.fq")
+    write_fastq(fq, random_reads(20000, seed=7))
+    with open(fq, "rb") as f:
+        data = f.read()
+    half = data.index(b"\n@r10000\n") + 1
+    inputs = {"plain.fq.gz": data,
+              "gzip.fq.gz": gzip.compress(data),
+              "members.fq.gz": gzip.compress(data[:half]) + gzip.compress(data[half:])}
+    for name, content in inputs.items():
+        with open(os.path.join(tmp, name), "wb") as f:
+            f.write(content)
+    write_bgzf(os.path.join(tmp, "bgzf.fq.gz"), data)
+    runs = [(name, []) for name in inputs] + [("bgzf.fq.gz", []), ("bgzf.fq.gz", ["-t", "3"])]
+    zstd = shutil.which("zstd")
+    if zstd:
+        frames = b""
+        for i in range(0, len(data), 100000):
+            frames += Popen([zstd, "-q", "-c"], stdin=PIPE, stdout=PIPE).communicate(data[i:i + 100000])[0]
+        inputs = {"frame.fq.zst": Popen([zstd, "-q", "-c"], stdin=PIPE, stdout=PIPE).communicate(data)[0],
+                  "frames.fq.zst": frames}
+        for name, content in inputs.items():
+            with open(os.path.join(tmp, name), "wb") as f:
+                f.write(content)
+        p = Popen([SEQQS, "-p", "probe_", os.path.join(tmp, "frame.fq.zst")], cwd=tmp, stdout=devnull, stderr=PIPE)
+        if b"ZSTD=1" in p.communicate()[1]:
+            print("skipping zstd input: seqqs was built without ZSTD=1")
+        else:
+            runs += [("frame.fq.zst", []), ("frames.fq.zst", []), ("frames.fq.zst", ["-t", "3"])]
+    outputs = ["_len.txt", "_nucl.txt", "_qual.txt", "_summary.txt"]
+    results = list()
+    results.append(run(["-p", "plain_", fq], tmp) == 0)
+    for i, (name, opts) in enumerate(runs):
+        results.append(run(opts + ["-p", "codec%d_" % i, os.path.join(tmp, name)], tmp) == 0)
+        results.append(same_files(tmp, "plain_", "codec%d_" % i, outputs))
+    return all(results)
+
+def test_complexity(tmp):
+    """
+    DUST windows stop at a non-ACGT base, as in sdust: a poly-A read
+    split by an N scores as its halves, not as one long run.
+    """
+    fq = os.path.join(tmp, "dust.fq")
+    reads = [("split", "A" * 30 + "N" + "A" * 30), ("whole", "A" * 61), ("ends", "A" * 40 + "N")]
+    with open(fq, "w") as f:
+        for name, seq in reads:
+            f.write("@%s\n%s\n+\n%s\n" % (name, seq, "I" * len(seq)))
+    results = list()
+    results.append(run(["--complexity", "-p", "cx_", fq], tmp) == 0)
+    with open(os.path.join(tmp, "cx__complexity.txt")) as f:
+        text = f.read()
+    dust = [line.split("\t") for line in text[text.index("dust\treads"):].split("\n")[1:] if line]
+    scores = dict((int(s), int(n)) for s, n in dust if int(n))
+    # 28 AAA triplets score 28*27/2/27 = 14, 59 score 29, 38 score 19
+    results.append(scores == {14: 1, 19: 1, 29: 1})
+    return all(results)
+
+def test_quiet(tmp):
+    """A successful run writes nothing to stderr, unless -v asks for its peak memory."""
+    fq = os.path.join(tmp, "quiet.fq")
+    make_reads(fq, 100)
+    results = list()
+    for opts, expected in (([], b""), (["-v"], b"peak memory")):
+        p = Popen([SEQQS] + opts + ["-p", "q_", fq], cwd=tmp, stdout=devnull, stderr=PIPE)
+        err = p.communicate()[1]
+        results.append(p.returncode == 0 and (expected in err if expected else not err))
+    return all(results)
+
+def test_demux(tmp):
+    """
+    Reads go to the sample whose index their Casava comment carries,
+    exactly or with one mismatch; the rest are undetermined.
+    """
+    samples = os.path.join(tmp, "samples.txt")
+    with open(samples, "w") as f:
+        f.write("# sample\tindex\nA\tACGTAC\nB\tTTGGCC\n")
+    fq = os.path.join(tmp, "demux.fq")
+    # index, and how many reads carry it
+    counts = (("ACGTAC", 30), ("ACGTAA", 20), ("TTGGCC", 40), ("TTGGCA", 5), ("GGGGGG", 7))
+    with open(fq, "w") as f:
+        i = 0
+        for index, n in counts:
+            for _ in range(n):
+                f.write("@r%d 1:N:0:%s\nACGTACGT\n+\nIIIIIIII\n" % (i, index))
+                i += 1
+    results = list()
+    results.append(run(["--demux", samples, "-p", "d_", fq], tmp) == 0)
+    with open(os.path.join(tmp, "d__demux.txt")) as f:
+        rows = [line.split() for line in f]
+    results.append(rows == [["sample", "index", "reads", "one_mismatch"],
+                            ["A", "ACGTAC", "50", "20"],
+                            ["B", "TTGGCC", "45", "5"],
+                            ["undetermined", "-", "7", "0"]])
+    results.append(read_summary(os.path.join(tmp, "d__A_summary.txt"))["reads"] == 50)
+    results.append(read_summary(os.path.join(tmp, "d__B_summary.txt"))["reads"] == 45)
+    return all(results)
+
+def read_table(fn):
+    """A TSV table as its header and rows, numbers as ints."""
+    with open(fn) as f:
+        rows = [line.rstrip("\n").split("\t") for line in f if line.strip()]
+    return rows[0], [[int(x) if x.lstrip("-").isdigit() else x for x in row] for row in rows[1:]]
+
+def read_json(fn):
+    """A --format json document, or None if it does not parse."""
+    with open(fn, encoding="latin-1") as f:
+        try:
+            return json.load(f)
+        except ValueError:
+            return None
+
+def read_bin(fn):
+    """The sets of a --format bin file, as dicts of table name -> (columns, rows), or None if malformed."""
+    with open(fn, "rb") as f:
+        data = f.read()
+    if data[:4] != b"SQQS":
+        return None
+    version, n_sets = struct.unpack_from("<II", data, 4)
+    off = 12
+    sets = list()
+    for s in range(n_sets):
+        (n_tables,) = struct.unpack_from("<I", data, off)
+        off += 4
+        tables = dict()
+        for t in range(n_tables):
+            name = data[off + 1:off + 1 + data[off]].decode()
+            off += 1 + data[off]
+            n_cols, n_rows = struct.unpack_from("<IQ", data, off)
+            off += 12
+            cols = list()
+            for c in range(n_cols):
+                cname = data[off + 1:off + 1 + data[off]].decode("latin-1")
+                off += 1 + data[off]
+                ctype, width = struct.unpack_from("<BI", data, off)
+                off += 5
+                cols.append((cname, ctype, width))
+            values = list()
+            for cname, ctype, width in cols:
+                if ctype == 0:
+                    values.append(list(struct.unpack_from("<%dQ" % n_rows, data, off)))
+                elif ctype == 1:
+                    values.append([data[off + i*width:off + (i+1)*width].rstrip(b"\0").decode("latin-1")
+                                   for i in range(n_rows)])
+                elif ctype == 2:
+                    values.append(list(struct.unpack_from("<%dd" % n_rows, data, off)))
+                else:
+                    return None
+                off += n_rows*width
+            tables[name] = ([c[0] for c in cols], [list(row) for row in zip(*values)])
+        sets.append(tables)
+    return sets if off == len(data) and version == 1 else None
+
+def test_formats(tmp):
+    """
+    --format json parses as JSON, and --format bin walks to its end,
+    whatever bytes the reads hold; both carry the same tables as the
+    TSV files.
+    """
+    fq = os.path.join(tmp, "formats.fq")
+    reads = random_reads(500, seed=4)
+    # IUPAC codes, and bytes JSON has to escape, inside k-mers and read starts
+    odd = ["ACGTNRYKMSWBDHVACGT", 'ACG"TAC\\GTA\x01CGT', "NNNNNNNNNN"]
+    reads += [("odd%d" % i, s, "I" * len(s)) for i in range(20) for s in odd]
+    write_fastq(fq, reads)
+    results = list()
+    opts = ["-k", "3", "--kmer-all", "--overrep", "0.01"]
+    results.append(run(opts + ["-p", "tsv_", fq], tmp) == 0)
+    results.append(run(opts + ["--format", "json", "-p", "json_", fq], tmp) == 0)
+    results.append(run(opts + ["--format", "bin", "-p", "bin_", fq], tmp) == 0)
+    doc = read_json(os.path.join(tmp, "json__stats.json"))
+    sets = read_bin(os.path.join(tmp, "bin__stats.bin"))
+    results.append(doc is not None and len(doc["sets"]) == 1 and sets is not None and len(sets) == 1)
+    if not all(results):
+        return False
+    js, bs = doc["sets"][0], sets[0]
+    summary = read_summary(os.path.join(tmp, "tsv__summary.txt"))
+    results.append(js["summary"] == summary)
+    results.append(len(bs["summary"][1]) == 1 and dict(zip(bs["summary"][0], bs["summary"][1][0])) == summary)
+    for name in ("nucl", "len", "kmer"):
+        columns, rows = read_table(os.path.join(tmp, "tsv__%s.txt" % name))
+        results.append(js[name]["rows"] == rows)
+        results.append(bs[name][1] == rows)
+    results.append(sorted(k for k in js if k != "summary") == sorted(k for k in bs if k != "summary"))
+    results.append(any('"' in row[0] for row in js["kmer"]["rows"]))
+    # with -i, one set per mate
+    results.append(run(["-i", "--format", "json", "-p", "json_i_", fq], tmp) == 0)
+    results.append(run(["-i", "--format", "bin", "-p", "bin_i_", fq], tmp) == 0)
+    doc = read_json(os.path.join(tmp, "json_i__stats.json"))
+    results.append(doc is not None and len(doc["sets"]) == 2)
+    sets = read_bin(os.path.join(tmp, "bin_i__stats.bin"))
+    results.append(sets is not None and len(sets) == 2)
+    return all(results)
+
+if __name__ == "__main__":
+    tmp = tempfile.mkdtemp(prefix="seqqs-test-")
+    tests = list()
+    tests.append(("test_sample_totals", test_sample_totals(tmp)))
+    tests.append(("test_formats", test_formats(tmp)))
+    tests.append(("test_kmer_spill", test_kmer_spill(tmp)))
+    tests.append(("test_resume", test_resume(tmp)))
+    tests.append(("test_pair_names", test_pair_names(tmp)))
+    tests.append(("test_bam", test_bam(tmp)))
+    tests.append(("test_demux", test_demux(tmp)))
+    tests.append(("test_insert", test_insert(tmp)))
+    tests.append(("test_pairs_stats", test_pairs_stats(tmp)))
+    tests.append(("test_codecs", test_codecs(tmp)))
+    tests.append(("test_complexity", test_complexity(tmp)))
+    tests.append(("test_quiet", test_quiet(tmp)))
+    shutil.rmtree(tmp)
+    total = 0
+    passed = 0
+    print("results:")
+    for name, value in tests:
+        total += 1
+        passed += int(value)
+        print("\t%s\t%s" % (name, ["Failed", "Passed"][int(value)]))
+    if passed < total:
+        sys.exit("%d/%d tests failed!\n" % (total - passed, total))
+    sys.stderr.write("%d/%d tests passed.\n" % (passed, total))
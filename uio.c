@@ -0,0 +1,807 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include "uio.h"
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+#define UIO_ENTRIES 8
+
+enum { BUF_IDLE, BUF_BUSY, BUF_DONE };
+
+static void uio_die(const char *func, const char *what) {
+  fprintf(stderr, "[%s] error: %s: %s\n", func, what, strerror(errno));
+  exit(1);
+}
+
+/*
+   A minimal io_uring: one submission and one completion ring, driven
+   through the raw system calls so no liburing is needed.
+*/
+#if defined(__linux__) && defined(__NR_io_uring_setup) && defined(IORING_FEAT_RW_CUR_POS)
+
+struct _uio_ring_t {
+  int fd;
+  unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_sqe *sqes;
+  struct io_uring_cqe *cqes;
+  void *sq_ptr, *cq_ptr;
+  size_t sq_sz, cq_sz, sqes_sz;
+  unsigned to_submit;
+};
+
+static uio_ring_t *ring_init(unsigned entries) {
+  struct io_uring_params p;
+  uio_ring_t *r;
+  char *sq, *cq;
+  int fd;
+
+  if (getenv("SEQQS_NO_URING")) return NULL;
+  memset(&p, 0, sizeof(p));
+  fd = syscall(__NR_io_uring_setup, entries, &p);
+  if (fd < 0) return NULL;
+  /* IORING_OP_READ and WRITE arrived with this feature */
+  if (!(p.features & IORING_FEAT_RW_CUR_POS)) {
+    close(fd);
+    return NULL;
+  }
+
+  r = calloc(1, sizeof(uio_ring_t));
+  r->fd = fd;
+  r->sq_sz = p.sq_off.array + p.sq_entries*sizeof(unsigned);
+  r->cq_sz = p.cq_off.cqes + p.cq_entries*sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    if (r->cq_sz > r->sq_sz) r->sq_sz = r->cq_sz;
+    r->cq_sz = r->sq_sz;
+  }
+  r->sq_ptr = mmap(NULL, r->sq_sz, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (r->sq_ptr == MAP_FAILED) goto fail;
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    r->cq_ptr = r->sq_ptr;
+  } else {
+    r->cq_ptr = mmap(NULL, r->cq_sz, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if (r->cq_ptr == MAP_FAILED) goto fail;
+  }
+  r->sqes_sz = p.sq_entries*sizeof(struct io_uring_sqe);
+  r->sqes = mmap(NULL, r->sqes_sz, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (r->sqes == MAP_FAILED) goto fail;
+
+  sq = r->sq_ptr;
+  cq = r->cq_ptr;
+  r->sq_head = (unsigned *) (sq + p.sq_off.head);
+  r->sq_tail = (unsigned *) (sq + p.sq_off.tail);
+  r->sq_mask = (unsigned *) (sq + p.sq_off.ring_mask);
+  r->sq_array = (unsigned *) (sq + p.sq_off.array);
+  r->cq_head = (unsigned *) (cq + p.cq_off.head);
+  r->cq_tail = (unsigned *) (cq + p.cq_off.tail);
+  r->cq_mask = (unsigned *) (cq + p.cq_off.ring_mask);
+  r->cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+  return r;
+
+ fail:
+  /* the ring is unusable, but blocking I/O still works */
+  if (r->sq_ptr && r->sq_ptr != MAP_FAILED) munmap(r->sq_ptr, r->sq_sz);
+  if (r->cq_ptr && r->cq_ptr != MAP_FAILED && r->cq_ptr != r->sq_ptr) munmap(r->cq_ptr, r->cq_sz);
+  close(fd);
+  free(r);
+  return NULL;
+}
+
+static void ring_destroy(uio_ring_t *r) {
+  if (!r) return;
+  munmap(r->sqes, r->sqes_sz);
+  if (r->cq_ptr != r->sq_ptr) munmap(r->cq_ptr, r->cq_sz);
+  munmap(r->sq_ptr, r->sq_sz);
+  close(r->fd);
+  free(r);
+}
+
+static void ring_prep(uio_ring_t *r, int write, int fd, void *buf, size_t n, uint64_t off, unsigned id) {
+  unsigned tail = *r->sq_tail, i = tail & *r->sq_mask;
+  struct io_uring_sqe *sqe = &r->sqes[i];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+  sqe->fd = fd;
+  sqe->addr = (uint64_t) (uintptr_t) buf;
+  sqe->len = n;
+  sqe->off = off;
+  sqe->user_data = id;
+  r->sq_array[i] = i;
+  __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  r->to_submit++;
+}
+
+/* submit anything queued, and wait for at least one completion */
+static void ring_wait(uio_ring_t *r) {
+  int ret;
+  for (;;) {
+    ret = syscall(__NR_io_uring_enter, r->fd, r->to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+    if (ret >= 0) break;
+    if (errno != EINTR) uio_die(__func__, "io_uring_enter failed");
+  }
+  r->to_submit -= ret < r->to_submit ? ret : r->to_submit;
+}
+
+static int ring_cqe(uio_ring_t *r, unsigned *id, int *res) {
+  unsigned head = *r->cq_head;
+  struct io_uring_cqe *cqe;
+  if (head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) return 0;
+  cqe = &r->cqes[head & *r->cq_mask];
+  *id = cqe->user_data;
+  *res = cqe->res;
+  __atomic_store_n(r->cq_head, head + 1, __ATOMIC_RELEASE);
+  return 1;
+}
+
+#else /* no io_uring: always use blocking I/O */
+
+struct _uio_ring_t {
+  int unused;
+};
+
+static uio_ring_t *ring_init(unsigned entries) { return NULL; }
+static void ring_destroy(uio_ring_t *r) { }
+static void ring_prep(uio_ring_t *r, int write, int fd, void *buf, size_t n, uint64_t off, unsigned id) { }
+static void ring_wait(uio_ring_t *r) { }
+static int ring_cqe(uio_ring_t *r, unsigned *id, int *res) { return 0; }
+
+#endif
+
+static int is_regular(int fd) {
+  struct stat st;
+  return fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+static void bufs_init(uio_buf_t *bufs) {
+  unsigned i;
+  for (i = 0; i < UIO_NBUFS; i++) {
+    memset(&bufs[i], 0, sizeof(uio_buf_t));
+    bufs[i].s = malloc(UIO_BUFSIZE);
+  }
+}
+
+/*
+   Reading: every buffer has a read in flight at consecutive offsets,
+   and each buffer is resubmitted at the next offset once consumed.
+   Short reads are continued until the buffer is full or at end of
+   file, so a buffer that is not full marks the end of the input.
+*/
+static void reader_submit(uio_reader_t *r, unsigned i) {
+  uio_buf_t *b = &r->bufs[i];
+  b->state = BUF_BUSY;
+  ring_prep(r->ring, 0, r->fd, b->s + b->l, UIO_BUFSIZE - b->l, b->off + b->l, i);
+}
+
+static void reader_queue(uio_reader_t *r, unsigned i) {
+  uio_buf_t *b = &r->bufs[i];
+  b->l = 0;
+  b->off = r->next_off;
+  r->next_off += UIO_BUFSIZE;
+  if (r->ring) reader_submit(r, i);
+  else b->state = BUF_IDLE;
+}
+
+static void reader_wait(uio_reader_t *r, unsigned i) {
+  uio_buf_t *b = &r->bufs[i];
+  unsigned id;
+  int res;
+  ssize_t n;
+
+  if (!r->ring) {
+    /* blocking: fill the whole buffer, or up to end of file */
+    while (b->state != BUF_DONE) {
+      n = read(r->fd, b->s + b->l, UIO_BUFSIZE - b->l);
+      if (n < 0 && errno == EINTR) continue;
+      if (n < 0) uio_die(__func__, "read failed");
+      b->l += n;
+      if (!n || b->l == UIO_BUFSIZE) b->state = BUF_DONE;
+    }
+    return;
+  }
+
+  while (b->state != BUF_DONE) {
+    ring_wait(r->ring);
+    while (ring_cqe(r->ring, &id, &res)) {
+      if (res == -EINTR || res == -EAGAIN) {
+	reader_submit(r, id);
+	continue;
+      }
+      if (res < 0) {
+	errno = -res;
+	uio_die(__func__, "read failed");
+      }
+      r->bufs[id].l += res;
+      if (res && r->bufs[id].l < UIO_BUFSIZE) reader_submit(r, id);
+      else r->bufs[id].state = BUF_DONE;
+    }
+  }
+}
+
+uio_reader_t *uio_ropen(int fd) {
+  uio_reader_t *r = calloc(1, sizeof(uio_reader_t));
+  off_t pos;
+  unsigned i;
+  r->fd = fd;
+  bufs_init(r->bufs);
+  /* offsets only make sense for regular files */
+  if (is_regular(fd) && (pos = lseek(fd, 0, SEEK_CUR)) >= 0) {
+    r->seekable = 1;
+    r->start = r->next_off = pos;
+    r->ring = ring_init(UIO_ENTRIES);
+  }
+  for (i = 0; i < UIO_NBUFS; i++) reader_queue(r, i);
+  return r;
+}
+
+/*
+   The next chunk of input, without copying; valid until the next
+   call. Returns 0 at end of file.
+*/
+size_t uio_next(uio_reader_t *r, const char **p) {
+  uio_buf_t *b = &r->bufs[r->cur];
+  if (r->held) {
+    if (b->l < UIO_BUFSIZE) return 0;
+    r->held = 0;
+    reader_queue(r, r->cur);
+    r->cur = (r->cur + 1) % UIO_NBUFS;
+    b = &r->bufs[r->cur];
+  }
+  reader_wait(r, r->cur);
+  r->held = 1;
+  r->n_in += b->l;
+  *p = b->s;
+  return b->l;
+}
+
+void uio_rclose(uio_reader_t *r) {
+  unsigned i, id, busy;
+  int res;
+  if (!r) return;
+  /* reads still in flight must land before their buffers are freed */
+  for (;;) {
+    for (i = busy = 0; i < UIO_NBUFS; i++) busy += r->bufs[i].state == BUF_BUSY;
+    if (!busy) break;
+    ring_wait(r->ring);
+    while (ring_cqe(r->ring, &id, &res)) r->bufs[id].state = BUF_DONE;
+  }
+  ring_destroy(r->ring);
+  for (i = 0; i < UIO_NBUFS; i++) free(r->bufs[i].s);
+  if (r->own_fd) close(r->fd);
+  free(r);
+}
+
+/*
+   Writing: full buffers are submitted as they fill. Regular files get
+   explicit offsets, so all buffers can be in flight at once; pipes and
+   files opened for appending keep a single write in flight, so output
+   stays in order.
+*/
+static void writer_submit(uio_writer_t *w, unsigned i) {
+  uio_buf_t *b = &w->bufs[i];
+  b->state = BUF_BUSY;
+  ring_prep(w->ring, 1, w->fd, b->s + b->done, b->l - b->done,
+	    w->seekable ? b->off + b->done : (uint64_t) -1, i);
+}
+
+static void writer_wait(uio_writer_t *w, unsigned i) {
+  uio_buf_t *b;
+  unsigned id;
+  int res;
+  while (w->bufs[i].state == BUF_BUSY) {
+    ring_wait(w->ring);
+    while (ring_cqe(w->ring, &id, &res)) {
+      b = &w->bufs[id];
+      if (res == -EINTR || res == -EAGAIN) {
+	writer_submit(w, id);
+	continue;
+      }
+      if (res <= 0) {
+	errno = res ? -res : EIO;
+	uio_die(__func__, "write failed");
+      }
+      b->done += res;
+      if (b->done < b->l) {
+	writer_submit(w, id);
+      } else {
+	b->state = BUF_IDLE;
+	b->l = b->done = 0;
+      }
+    }
+  }
+}
+
+static void writer_flush(uio_writer_t *w, unsigned i) {
+  uio_buf_t *b = &w->bufs[i];
+  unsigned j;
+  ssize_t n;
+
+  if (!b->l) return;
+  if (!w->ring) {
+    while (b->done < b->l) {
+      n = write(w->fd, b->s + b->done, b->l - b->done);
+      if (n < 0 && errno == EINTR) continue;
+      if (n < 0) uio_die(__func__, "write failed");
+      b->done += n;
+    }
+    b->l = b->done = 0;
+    return;
+  }
+  if (!w->seekable)
+    for (j = 0; j < UIO_NBUFS; j++) writer_wait(w, j);
+  b->off = w->off;
+  b->done = 0;
+  w->off += b->l;
+  writer_submit(w, i);
+}
+
+uio_writer_t *uio_wopen(int fd) {
+  uio_writer_t *w = calloc(1, sizeof(uio_writer_t));
+  off_t pos;
+  int flags = fcntl(fd, F_GETFL);
+  w->fd = fd;
+  bufs_init(w->bufs);
+  w->ring = ring_init(UIO_ENTRIES);
+  if (w->ring && is_regular(fd) && flags >= 0 && !(flags & O_APPEND)
+      && (pos = lseek(fd, 0, SEEK_CUR)) >= 0) {
+    w->seekable = 1;
+    w->off = pos;
+  }
+  return w;
+}
+
+uio_writer_t *uio_wfopen(const char *fn) {
+  uio_writer_t *w;
+  int fd = open(fn, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+  if (fd < 0) return NULL;
+  w = uio_wopen(fd);
+  w->own_fd = 1;
+  return w;
+}
+
+void uio_write(uio_writer_t *w, const void *p, size_t n) {
+  uio_buf_t *b;
+  size_t k;
+  const char *s = p;
+  while (n) {
+    b = &w->bufs[w->cur];
+    if (b->state == BUF_BUSY) writer_wait(w, w->cur);
+    k = UIO_BUFSIZE - b->l < n ? UIO_BUFSIZE - b->l : n;
+    memcpy(b->s + b->l, s, k);
+    b->l += k;
+    s += k;
+    n -= k;
+    if (b->l == UIO_BUFSIZE) {
+      writer_flush(w, w->cur);
+      w->cur = (w->cur + 1) % UIO_NBUFS;
+    }
+  }
+}
+
+void uio_putc(uio_writer_t *w, int c) {
+  uio_buf_t *b = &w->bufs[w->cur];
+  char ch = c;
+  if (b->state != BUF_BUSY && b->l < UIO_BUFSIZE - 1) b->s[b->l++] = c;
+  else uio_write(w, &ch, 1);
+}
+
+/* write out what is buffered and wait for it */
+void uio_wclose(uio_writer_t *w) {
+  unsigned i;
+  if (!w) return;
+  if (w->bufs[w->cur].state != BUF_BUSY) writer_flush(w, w->cur);
+  for (i = 0; i < UIO_NBUFS; i++) {
+    if (w->ring) writer_wait(w, i);
+    free(w->bufs[i].s);
+  }
+  ring_destroy(w->ring);
+  /* writes at explicit offsets leave the file position behind */
+  if (w->seekable && !w->own_fd) lseek(w->fd, w->off, SEEK_SET);
+  if (w->own_fd && close(w->fd) < 0) uio_die(__func__, "close failed");
+  free(w);
+}
+
+/*
+   kseq input. The first chunk read picks a codec from the table below
+   by its magic bytes; the codec decodes straight out of the read-ahead
+   buffers. Codecs are tried in order, and plain text, which takes
+   anything, comes last.
+*/
+static int in_fill(uio_in_t *in) {
+  const char *p;
+  size_t n = uio_next(in->r, &p);
+  if (!n) {
+    in->eof = 1;
+    return 0;
+  }
+  in->p = (const unsigned char *) p;
+  in->n = n;
+  return 1;
+}
+
+static size_t in_next(void *r, const char **p) {
+  return uio_next(r, p);
+}
+
+static int plain_sniff(const unsigned char *p, size_t n) { return 1; }
+static int plain_open(uio_in_t *in) { return 0; }
+static void plain_close(uio_in_t *in) { }
+
+static int plain_read(uio_in_t *in, void *buf, unsigned len) {
+  unsigned n, k;
+  for (n = 0; n < len; n += k) {
+    if (!in->n && (in->eof || !in_fill(in))) break;
+    k = in->n < len - n ? in->n : len - n;
+    memcpy((char *) buf + n, in->p, k);
+    in->p += k;
+    in->n -= k;
+  }
+  return n;
+}
+
+static int gzip_sniff(const unsigned char *p, size_t n) {
+  return n >= 2 && p[0] == 0x1f && p[1] == 0x8b;
+}
+
+static int gzip_open(uio_in_t *in) {
+  if (inflateInit2(&in->zs, 15 + 16) != Z_OK) {
+    fprintf(stderr, "[%s] error: cannot initialize zlib.\n", __func__);
+    return -1;
+  }
+  return 0;
+}
+
+/* concatenated members are read through, as by gzread */
+static int gzip_read(uio_in_t *in, void *buf, unsigned len) {
+  int ret;
+  in->zs.next_out = buf;
+  in->zs.avail_out = len;
+  while (in->zs.avail_out) {
+    if (!in->n && (in->eof || !in_fill(in))) {
+      if (!in->member_end)
+	fprintf(stderr, "[%s] warning: truncated gzip input.\n", __func__);
+      in->member_end = 1;
+      break;
+    }
+    /* like gzread, anything after a member that is not another member is ignored */
+    if (in->member_end) {
+      if (in->p[0] != 0x1f) {
+	in->eof = 1;
+	in->n = 0;
+	break;
+      }
+      in->member_end = 0;
+    }
+    in->zs.next_in = (unsigned char *) in->p;
+    in->zs.avail_in = in->n;
+    ret = inflate(&in->zs, Z_NO_FLUSH);
+    in->p = in->zs.next_in;
+    in->n = in->zs.avail_in;
+    if (ret == Z_STREAM_END) {
+      inflateReset(&in->zs);
+      in->member_end = 1;
+    } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+      fprintf(stderr, "[%s] error: corrupt gzip input (%s).\n", __func__, in->zs.msg ? in->zs.msg : "zlib error");
+      exit(1);
+    }
+  }
+  return len - in->zs.avail_out;
+}
+
+static void gzip_close(uio_in_t *in) {
+  inflateEnd(&in->zs);
+}
+
+/* BGZF blocks, and zstd frames small enough to fit a chunk, are split between threads */
+static int bgzf_open(uio_in_t *in) {
+  in->dec = pdec_open(PDEC_BGZF, in_next, in->r, in->p, in->n, in->n_threads);
+  in->n = 0;
+  return 0;
+}
+
+static int zstd_frames_open(uio_in_t *in) {
+  in->dec = pdec_open(PDEC_ZSTD, in_next, in->r, in->p, in->n, in->n_threads);
+  in->n = 0;
+  return 0;
+}
+
+static int pdec_in_read(uio_in_t *in, void *buf, unsigned len) {
+  return pdec_read(in->dec, buf, len);
+}
+
+static void pdec_in_close(uio_in_t *in) {
+  pdec_close(in->dec);
+}
+
+static int zstd_sniff(const unsigned char *p, size_t n) {
+  return n >= 4 && p[0] == 0x28 && p[1] == 0xb5 && p[2] == 0x2f && p[3] == 0xfd;
+}
+
+#ifdef HAVE_ZSTD
+static int zstd_open(uio_in_t *in) {
+  if (!(in->zds = ZSTD_createDStream()) || ZSTD_isError(ZSTD_initDStream(in->zds))) {
+    fprintf(stderr, "[%s] error: cannot initialize zstd.\n", __func__);
+    return -1;
+  }
+  return 0;
+}
+
+static int zstd_read(uio_in_t *in, void *buf, unsigned len) {
+  ZSTD_outBuffer out = {buf, len, 0};
+  ZSTD_inBuffer zin;
+  size_t ret;
+  for (;;) {
+    zin.src = in->p;
+    zin.size = in->n;
+    zin.pos = 0;
+    ret = ZSTD_decompressStream(in->zds, &out, &zin);
+    if (ZSTD_isError(ret)) {
+      fprintf(stderr, "[%s] error: corrupt zstd input (%s).\n", __func__, ZSTD_getErrorName(ret));
+      exit(1);
+    }
+    in->p += zin.pos;
+    in->n -= zin.pos;
+    /* 0 once a frame is complete; the next call starts on the next frame */
+    if (!ret) in->member_end = 1;
+    else if (zin.pos) in->member_end = 0;
+    if (out.pos == out.size) break;
+    /* with room left and no input, everything decodable is out */
+    if (!in->n && (in->eof || !in_fill(in))) {
+      if (!in->member_end)
+	fprintf(stderr, "[%s] warning: truncated zstd input.\n", __func__);
+      in->member_end = 1;
+      break;
+    }
+  }
+  return out.pos;
+}
+
+static void zstd_close(uio_in_t *in) {
+  ZSTD_freeDStream(in->zds);
+}
+#else
+static int zstd_open(uio_in_t *in) {
+  fprintf(stderr, "[%s] error: zstd input needs a build with ZSTD=1.\n", __func__);
+  return -1;
+}
+static int zstd_read(uio_in_t *in, void *buf, unsigned len) { return 0; }
+static void zstd_close(uio_in_t *in) { }
+#endif
+
+static const uio_codec_t uio_codecs[] = {
+  {"bgzf", pdec_bgzf_check, bgzf_open, pdec_in_read, pdec_in_close},
+  {"gzip", gzip_sniff, gzip_open, gzip_read, gzip_close},
+  {"zstd", pdec_zstd_check, zstd_frames_open, pdec_in_read, pdec_in_close},
+  {"zstd", zstd_sniff, zstd_open, zstd_read, zstd_close},
+  {"plain", plain_sniff, plain_open, plain_read, plain_close}
+};
+
+/* n_threads decode BGZF or multi-frame zstd input */
+uio_in_t *uio_open(const char *fn, int n_threads) {
+  uio_in_t *in;
+  int fd = strcmp(fn, "-") ? open(fn, O_RDONLY) : 0;
+  if (fd < 0) return NULL;
+  in = calloc(1, sizeof(uio_in_t));
+  in->r = uio_ropen(fd);
+  in->r->own_fd = fd != 0;
+  in->n_threads = n_threads;
+  in_fill(in);
+  for (in->codec = uio_codecs; !in->codec->sniff(in->p, in->n); in->codec++)
+    ;
+  if (in->codec->open(in)) {
+    uio_rclose(in->r);
+    free(in);
+    return NULL;
+  }
+  return in;
+}
+
+int uio_read(uio_in_t *in, void *buf, unsigned len) {
+  unsigned n = 0;
+  if (in->n_peek) {
+    n = in->n_peek < len ? in->n_peek : len;
+    memcpy(buf, in->peek, n);
+    memmove(in->peek, in->peek + n, in->n_peek - n);
+    in->n_peek -= n;
+  }
+  n += in->codec->read(in, (char *) buf + n, len - n);
+  in->n_out += n;
+  return n;
+}
+
+/*
+   The first len (at most UIO_PEEK) decoded bytes, which uio_read()
+   still returns afterwards; for telling formats apart by what is
+   inside the compression.
+*/
+int uio_peek(uio_in_t *in, void *buf, unsigned len) {
+  int n;
+  if (len > UIO_PEEK) len = UIO_PEEK;
+  while (in->n_peek < len) {
+    if ((n = in->codec->read(in, in->peek + in->n_peek, len - in->n_peek)) <= 0) break;
+    in->n_peek += n;
+  }
+  len = in->n_peek < len ? in->n_peek : len;
+  memcpy(buf, in->peek, len);
+  return len;
+}
+
+/* the BGZF virtual offset of decoded offset off, as pdec_tell(), or -1 */
+int uio_tell(uio_in_t *in, uint64_t off, uint64_t *voff) {
+  return in->codec->open == bgzf_open ? pdec_tell(in->dec, off, voff) : -1;
+}
+
+/* start reading again at compressed offset off (from where reading started), if r is a regular file that long */
+static int in_restart(uio_in_t *in, uint64_t off) {
+  uio_reader_t *r = in->r;
+  struct stat st;
+  if (!r->seekable || fstat(r->fd, &st) < 0 || r->start + off > (uint64_t) st.st_size
+      || lseek(r->fd, r->start + off, SEEK_SET) < 0)
+    return -1;
+  in->r = uio_ropen(r->fd);
+  in->r->own_fd = r->own_fd;
+  in->r->start = r->start;
+  in->r->n_in = off;
+  r->own_fd = 0;
+  uio_rclose(r);
+  in->n = 0;
+  in->n_peek = 0;
+  in->eof = 0;
+  return 0;
+}
+
+/* 
+   Jump to decoded offset off (from where reading started) by
+   seeking: plain regular files go straight there, and BGZF ones to
+   the block at virtual offset voff (from uio_tell(), or UIO_NO_VOFF),
+   decoding only the part of it before off. Returns -1 if the caller
+   has to read its way there instead.
+*/
+int uio_seek(uio_in_t *in, uint64_t off, uint64_t voff) {
+  unsigned char buf[BGZF_MAX_BLOCK];
+  unsigned within = voff & 0xffff;
+  if (in->codec->read == plain_read) {
+    if (in_restart(in, off)) return -1;
+  } else if (in->codec->open == bgzf_open && voff != UIO_NO_VOFF && within <= off) {
+    if (in_restart(in, voff >> 16)) return -1;
+    pdec_close(in->dec);
+    in->dec = pdec_open(PDEC_BGZF, in_next, in->r, NULL, 0, in->n_threads);
+    in->dec->c_in = voff >> 16;
+    in->dec->d_off = off - within;
+    if (pdec_read(in->dec, buf, within) < within) {
+      fprintf(stderr, "[%s] error: the input ends before the block to resume from.\n", __func__);
+      exit(1);
+    }
+  } else {
+    return -1;
+  }
+  in->n_out = off;
+  return 0;
+}
+
+void uio_close(uio_in_t *in) {
+  if (!in) return;
+  in->codec->close(in);
+  uio_rclose(in->r);
+  free(in);
+}
+
+/* fills free chunks from each file in turn, until done or stopped */
+static void *cat_worker(void *data) {
+  uio_cat_t *c = data;
+  uio_in_t *in;
+  unsigned slot;
+  int i, eof = 0, l, stop = 0;
+  char last;
+
+  for (i = 0; i < c->n_fn; i++) {
+    if (!(in = uio_open(c->fn[i], 1))) {
+      fprintf(stderr, "[%s] error: cannot open '%s'.\n", __func__, c->fn[i]);
+      exit(1);
+    }
+    last = '\n';
+    do {
+      pthread_mutex_lock(&c->lock);
+      while (c->n == UIO_CAT_NCHUNKS && !c->stop) pthread_cond_wait(&c->room, &c->lock);
+      slot = (c->head + c->n) % UIO_CAT_NCHUNKS;
+      stop = c->stop;
+      pthread_mutex_unlock(&c->lock);
+      if (stop) break;
+
+      /* the slot is not queued yet, so the reader leaves it alone */
+      l = uio_read(in, c->chunks[slot], UIO_BUFSIZE - 1);
+      eof = l < UIO_BUFSIZE - 1;
+      if (l) last = c->chunks[slot][l-1];
+      if (eof && last != '\n') c->chunks[slot][l++] = '\n';
+      if (!l) break;
+
+      pthread_mutex_lock(&c->lock);
+      c->len[slot] = l;
+      c->n++;
+      pthread_cond_signal(&c->more);
+      pthread_mutex_unlock(&c->lock);
+    } while (!eof);
+    uio_close(in);
+    if (stop) break;
+  }
+
+  pthread_mutex_lock(&c->lock);
+  c->done = 1;
+  pthread_cond_signal(&c->more);
+  pthread_mutex_unlock(&c->lock);
+  return NULL;
+}
+
+/* returns NULL, with errno set, if any of the files cannot be read */
+uio_cat_t *uio_catopen(char *const *fn, int n_fn) {
+  uio_cat_t *c;
+  int i;
+  for (i = 0; i < n_fn; i++)
+    if (strcmp(fn[i], "-") && access(fn[i], R_OK) < 0) return NULL;
+  c = calloc(1, sizeof(uio_cat_t));
+  c->fn = malloc(n_fn*sizeof(char *));
+  for (i = 0; i < n_fn; i++) c->fn[i] = strdup(fn[i]);
+  c->n_fn = n_fn;
+  for (i = 0; i < UIO_CAT_NCHUNKS; i++) c->chunks[i] = malloc(UIO_BUFSIZE);
+  pthread_mutex_init(&c->lock, NULL);
+  pthread_cond_init(&c->more, NULL);
+  pthread_cond_init(&c->room, NULL);
+  if (pthread_create(&c->worker, NULL, cat_worker, c)) uio_die(__func__, "cannot start a reader thread");
+  return c;
+}
+
+/* like uio_read(), only short at the end of the last file */
+int uio_catread(uio_cat_t *c, void *buf, unsigned len) {
+  unsigned n = 0;
+  size_t m;
+  pthread_mutex_lock(&c->lock);
+  while (n < len) {
+    while (!c->n && !c->done) pthread_cond_wait(&c->more, &c->lock);
+    if (!c->n) break;
+    pthread_mutex_unlock(&c->lock);
+
+    m = c->len[c->head] - c->pos;
+    if (m > len - n) m = len - n;
+    memcpy((char *) buf + n, c->chunks[c->head] + c->pos, m);
+    n += m;
+    c->pos += m;
+
+    pthread_mutex_lock(&c->lock);
+    if (c->pos == c->len[c->head]) {
+      c->head = (c->head + 1) % UIO_CAT_NCHUNKS;
+      c->n--;
+      c->pos = 0;
+      pthread_cond_signal(&c->room);
+    }
+  }
+  pthread_mutex_unlock(&c->lock);
+  return n;
+}
+
+void uio_catclose(uio_cat_t *c) {
+  int i;
+  if (!c) return;
+  pthread_mutex_lock(&c->lock);
+  c->stop = 1;
+  pthread_cond_signal(&c->room);
+  pthread_mutex_unlock(&c->lock);
+  pthread_join(c->worker, NULL);
+  for (i = 0; i < UIO_CAT_NCHUNKS; i++) free(c->chunks[i]);
+  for (i = 0; i < c->n_fn; i++) free(c->fn[i]);
+  free(c->fn);
+  pthread_mutex_destroy(&c->lock);
+  pthread_cond_destroy(&c->more);
+  pthread_cond_destroy(&c->room);
+  free(c);
+}
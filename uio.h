@@ -0,0 +1,124 @@
+#ifndef UIO_H
+#define UIO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <zlib.h>
+#include "pdec.h"
+
+/* 
+   Buffered file I/O with several large requests in flight. On Linux,
+   regular files are read ahead and written through io_uring; pipes,
+   terminals, and kernels without io_uring fall back to plain blocking
+   read() and write(). Setting SEQQS_NO_URING forces the fallback.
+*/
+
+#define UIO_BUFSIZE (1<<20)
+#define UIO_NBUFS 4
+
+typedef struct _uio_ring_t uio_ring_t;
+
+typedef struct {
+  char *s;
+  size_t l; /* bytes read into, or queued in, the buffer */
+  size_t done; /* bytes of the current request already transferred */
+  uint64_t off; /* file offset of s[0] */
+  int state;
+} uio_buf_t;
+
+typedef struct {
+  int fd, own_fd, held, seekable;
+  uint64_t start; /* file offset reading started at, if seekable */
+  uint64_t next_off; /* offset of the next read to submit */
+  uint64_t n_in; /* bytes handed out so far */
+  unsigned cur; /* buffer being consumed */
+  uio_buf_t bufs[UIO_NBUFS];
+  uio_ring_t *ring; /* NULL with blocking reads */
+} uio_reader_t;
+
+typedef struct {
+  int fd, own_fd, seekable;
+  uint64_t off; /* offset of the next write, if seekable */
+  unsigned cur; /* buffer being filled */
+  uio_buf_t bufs[UIO_NBUFS];
+  uio_ring_t *ring; /* NULL with blocking writes */
+} uio_writer_t;
+
+/* 
+   Input for kseq, decoded by the codec its first bytes call for: gzip,
+   zstd (when built with ZSTD=1), or plain text passed through. BGZF
+   and zstd made of small frames are decoded by worker threads.
+*/
+#define UIO_PEEK 16
+#define UIO_NO_VOFF UINT64_MAX /* no BGZF virtual offset, for uio_seek() */
+
+typedef struct _uio_in_t uio_in_t;
+
+typedef struct {
+  const char *name;
+  int (*sniff)(const unsigned char *p, size_t n);
+  int (*open)(uio_in_t *in);
+  int (*read)(uio_in_t *in, void *buf, unsigned len);
+  void (*close)(uio_in_t *in);
+} uio_codec_t;
+
+struct _uio_in_t {
+  uio_reader_t *r;
+  const uio_codec_t *codec;
+  const unsigned char *p; /* input taken from r, not decoded yet */
+  size_t n;
+  int eof, member_end, n_threads;
+  z_stream zs;
+  void *zds; /* zstd stream */
+  pdec_t *dec; /* threaded decoding */
+  unsigned char peek[UIO_PEEK]; /* decoded by uio_peek(), not read yet */
+  unsigned n_peek;
+  uint64_t n_out; /* decoded bytes returned so far */
+};
+
+uio_reader_t *uio_ropen(int fd);
+size_t uio_next(uio_reader_t *r, const char **p);
+void uio_rclose(uio_reader_t *r);
+
+uio_writer_t *uio_wopen(int fd);
+uio_writer_t *uio_wfopen(const char *fn);
+void uio_write(uio_writer_t *w, const void *p, size_t n);
+void uio_putc(uio_writer_t *w, int c);
+void uio_wclose(uio_writer_t *w);
+
+/* 
+   Several inputs read back to back as one stream. A worker thread
+   inflates them, one after another, into a bounded queue of chunks, so
+   decompression overlaps with parsing, and the next file starts
+   inflating while the end of the current one is still being consumed.
+   A file not ending in a newline gets one, so records never run
+   together across files.
+*/
+#define UIO_CAT_NCHUNKS 8
+
+typedef struct {
+  char **fn;
+  int n_fn;
+  char *chunks[UIO_CAT_NCHUNKS];
+  size_t len[UIO_CAT_NCHUNKS];
+  unsigned head, n; /* oldest filled chunk, and number filled */
+  size_t pos; /* bytes of the oldest chunk already consumed */
+  int done, stop;
+  pthread_t worker;
+  pthread_mutex_t lock;
+  pthread_cond_t more, room;
+} uio_cat_t;
+
+uio_in_t *uio_open(const char *fn, int n_threads);
+int uio_read(uio_in_t *in, void *buf, unsigned len);
+int uio_peek(uio_in_t *in, void *buf, unsigned len);
+int uio_tell(uio_in_t *in, uint64_t off, uint64_t *voff);
+int uio_seek(uio_in_t *in, uint64_t off, uint64_t voff);
+void uio_close(uio_in_t *in);
+
+uio_cat_t *uio_catopen(char *const *fn, int n_fn);
+int uio_catread(uio_cat_t *c, void *buf, unsigned len);
+void uio_catclose(uio_cat_t *c);
+
+#endif